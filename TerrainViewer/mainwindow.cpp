@@ -22,10 +22,24 @@ MainWindow::MainWindow(QWidget *parent)
 void MainWindow::loadFile()
 {
 	// Ask the user for a file to import
-	QString fileName = QFileDialog::getOpenFileName(this, tr("Load a terrain"), "", tr("Images (*.png *.jpg)"));
+	QString fileName = QFileDialog::getOpenFileName(this, tr("Load a terrain"), "",
+													tr("Terrains (*.png *.jpg *.tif *.tiff *.pfm *.exr *.terrain);;Binary terrains (*.terrain)"));
 
+	// Binary terrains store their dimensions, they are mapped in memory
+	if (QFileInfo(fileName).suffix() == "terrain")
+	{
+		TerrainViewer::Terrain terrain(0.0f, 0.0f, 0.0f);
+		if (terrain.loadBinary(fileName.toStdString()))
+		{
+			ui.terrainViewerWidget->loadTerrain(std::move(terrain));
+		}
+		else
+		{
+			QMessageBox::critical(this, tr("Impossible to import"), tr("It is not a valid binary terrain file"));
+		}
+	}
 	// Check if file exists
-	if (QFileInfo::exists(fileName))
+	else if (QFileInfo::exists(fileName))
 	{
 		// Ask the user for the size of the terrain
 		auto dialog = new TerrainViewer::OpenTerrainDialog(this);
@@ -35,10 +49,14 @@ void MainWindow::loadFile()
 		{
 			const auto image = cv::imread(fileName.toStdString(), cv::ImreadModes::IMREAD_ANYDEPTH);
 
+			// 16 bits height maps keep their precision on 16 bits, they are shared with the image instead of converted
+			const auto sampleType = (image.type() == CV_16U) ? TerrainViewer::TerrainSampleType::uint16
+															 : TerrainViewer::TerrainSampleType::float32;
+
 			TerrainViewer::Terrain terrain(dialog->sizeX(), dialog->sizeY(), dialog->maxAltitude());
-			if (terrain.loadFromImage(image))
+			if (terrain.loadFromImage(image, sampleType))
 			{
-				ui.terrainViewerWidget->loadTerrain(terrain);
+				ui.terrainViewerWidget->loadTerrain(std::move(terrain));
 			}
 			else
 			{
@@ -54,8 +72,9 @@ void MainWindow::exportNormalMap()
 
 	if (!filename.isEmpty())
 	{
-		const auto& terrain = ui.terrainViewerWidget->terrain();
-		const auto image = TerrainViewer::normalTextureImage(terrain);
+		// Normals are shared with the viewer, computed only once
+		auto& products = ui.terrainViewerWidget->products();
+		const auto image = TerrainViewer::normalTextureImage(products);
 
 		if (!image.save(filename))
 		{
@@ -70,9 +89,10 @@ void MainWindow::exportLightMap()
 
 	if (!filename.isEmpty())
 	{
-		const auto& terrain = ui.terrainViewerWidget->terrain();
+		// The light map displayed in the viewer is reused
+		auto& products = ui.terrainViewerWidget->products();
 		const auto& parameters = ui.terrainViewerWidget->parameters();
-		const auto image = lightMapTextureImage(terrain, parameters);
+		const auto image = lightMapTextureImage(products, parameters);
 
 		if (!image.save(filename))
 		{
@@ -87,9 +107,10 @@ void MainWindow::exportDemTexture()
 
 	if (!filename.isEmpty())
 	{
-		const auto& terrain = ui.terrainViewerWidget->terrain();
+		// The light map displayed in the viewer is reused
+		auto& products = ui.terrainViewerWidget->products();
 		const auto& parameters = ui.terrainViewerWidget->parameters();
-		const auto image = demTextureImage(terrain, parameters);
+		const auto image = demTextureImage(products, parameters);
 
 		if (!image.save(filename))
 		{
@@ -98,10 +119,32 @@ void MainWindow::exportDemTexture()
 	}
 }
 
+void MainWindow::exportTerrain()
+{
+	const QString filename = QFileDialog::getSaveFileName(this, tr("Save terrain"), "",
+														  tr("Binary terrains (*.terrain);;Float height maps (*.tif *.tiff *.pfm *.exr)"));
+
+	if (!filename.isEmpty())
+	{
+		const auto& terrain = ui.terrainViewerWidget->terrain();
+
+		// Images store the altitudes themselves, other files are binary terrains with the sample type of the terrain
+		const QString suffix = QFileInfo(filename).suffix().toLower();
+		const bool floatImage = (suffix == "tif" || suffix == "tiff" || suffix == "pfm" || suffix == "exr");
+
+		if (!(floatImage ? terrain.saveInFloat32(filename.toStdString())
+						 : terrain.saveBinary(filename.toStdString(), terrain.sampleType())))
+		{
+			QMessageBox::critical(this, tr("Error while saving"), tr("Impossible to save the terrain"));
+		}
+	}
+}
+
 void MainWindow::resetViewerWidget()
 {
 	const auto camera = ui.terrainViewerWidget->camera();
-	const auto terrain = ui.terrainViewerWidget->terrain();
+	// The copy shares the altitudes of the current widget, they are not copied
+	auto terrain = ui.terrainViewerWidget->terrain();
 
 	// Delete current viewer widget
 	ui.terrainViewerWidget->cleanup();
@@ -112,9 +155,9 @@ void MainWindow::resetViewerWidget()
 	ui.verticalLayout->addWidget(ui.terrainViewerWidget);
 
 	// Keep the same parameters in the new widget
-	QTimer::singleShot(0, this, [this, camera, terrain]() {
+	QTimer::singleShot(0, this, [this, camera, terrain = std::move(terrain)]() mutable {
 		ui.terrainViewerWidget->setCamera(camera);
-		ui.terrainViewerWidget->loadTerrain(terrain);
+		ui.terrainViewerWidget->loadTerrain(std::move(terrain));
 		ui.terrainViewerWidget->setParameters(m_parameterDock->parameters());
 	});
 }
@@ -150,6 +193,7 @@ void MainWindow::createActions()
 	connect(ui.actionExport_normal_map, &QAction::triggered, this, &MainWindow::exportNormalMap);
 	connect(ui.actionExport_light_map, &QAction::triggered, this, &MainWindow::exportLightMap);
 	connect(ui.actionExport_DEM_texture, &QAction::triggered, this, &MainWindow::exportDemTexture);
+	connect(ui.actionExport_terrain, &QAction::triggered, this, &MainWindow::exportTerrain);
 	connect(ui.actionInitialize_water, &QAction::triggered, this, &MainWindow::initWaterSimulation);
 	connect(ui.actionPauseSimulation, &QAction::triggered, this, &MainWindow::pauseWaterSimulation);
 	connect(ui.actionResumeSimulation, &QAction::triggered, this, &MainWindow::resumeWaterSimulation);
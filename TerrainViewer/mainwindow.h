@@ -21,6 +21,8 @@ private slots:
 
 	void exportDemTexture();
 
+	void exportTerrain();
+
 	void resetViewerWidget();
 
 	void initWaterSimulation();
@@ -0,0 +1,106 @@
+#ifndef HORIZONCACHE_H
+#define HORIZONCACHE_H
+
+#include <vector>
+
+#include <QString>
+
+#include "terrain.h"
+#include "terrainviewerparameters.h"
+#include "occlusion.h"
+
+namespace TerrainViewer
+{
+
+/**
+ * \brief A persistent cache of horizon angles and light maps on disk.
+ *        Entries are keyed by a hash of the terrain data, its dimensions and the parameters
+ *        used to compute them, see terrainHash, computed once by the caller for all the entries of a terrain. Each entry starts with a versioned header that is checked when
+ *        loading, so that stale or corrupted entries are ignored and computed again.
+ */
+class HorizonCache
+{
+public:
+	// Version of the file format, increment it when the format or the algorithms change
+	static const quint32 version;
+
+	/**
+	 * \brief Create a cache in the standard cache location of the application
+	 */
+	HorizonCache();
+
+	/**
+	 * \brief Create a cache in a directory
+	 * \param directory The directory in which entries are stored, created if needed
+	 */
+	explicit HorizonCache(const QString& directory);
+
+	/**
+	 * \brief Return the directory in which entries are stored
+	 * \return The directory in which entries are stored
+	 */
+	const QString& directory() const;
+
+	/**
+	 * \brief Load the horizon angles of a terrain from the cache
+	 * \param terrain A terrain
+	 * \param terrainHash The hash of the terrain, see terrainHash
+	 * \param directions The preset for the number of azimuthal directions
+	 * \param precision Storage precision of the horizon angles
+	 * \param nearFieldRadius Radius of the near field of the horizon angles, 0 if they are exact
+	 * \param horizonAngles The loaded horizon angles, unchanged if there is no valid entry
+	 * \return True if the horizon angles were in the cache, false otherwise
+	 */
+	bool loadHorizonAngles(const Terrain& terrain,
+						   quint64 terrainHash,
+						   HorizonDirections directions,
+						   HorizonPrecision precision,
+						   int nearFieldRadius,
+						   AnyHorizonAngles& horizonAngles) const;
+
+	/**
+	 * \brief Save the horizon angles of a terrain in the cache
+	 * \param terrain A terrain
+	 * \param terrainHash The hash of the terrain, see terrainHash
+	 * \param nearFieldRadius Radius of the near field of the horizon angles, 0 if they are exact
+	 * \param horizonAngles The horizon angles of the terrain
+	 * \return True if the entry was written, false otherwise
+	 */
+	bool saveHorizonAngles(const Terrain& terrain, quint64 terrainHash, int nearFieldRadius, const AnyHorizonAngles& horizonAngles) const;
+
+	/**
+	 * \brief Load the light map of a terrain from the cache
+	 * \param terrain A terrain
+	 * \param terrainHash The hash of the terrain, see terrainHash
+	 * \param parameters Parameters with the shading, the number of directions and the precision
+	 * \param lightMap The loaded light map, unchanged if there is no valid entry
+	 * \return True if the light map was in the cache, false otherwise
+	 */
+	bool loadLightMap(const Terrain& terrain, quint64 terrainHash, const Parameters& parameters, std::vector<float>& lightMap) const;
+
+	/**
+	 * \brief Save the light map of a terrain in the cache
+	 * \param terrain A terrain
+	 * \param terrainHash The hash of the terrain, see terrainHash
+	 * \param parameters Parameters with the shading, the number of directions and the precision
+	 * \param lightMap The light map of the terrain
+	 * \return True if the entry was written, false otherwise
+	 */
+	bool saveLightMap(const Terrain& terrain, quint64 terrainHash, const Parameters& parameters, const std::vector<float>& lightMap) const;
+
+	/**
+	 * \brief Compute a hash of the data and the dimensions of a terrain. The hash function is XXH64,
+	 *        so that the keys of the entries do not depend on the version of Qt. It reads the whole terrain,
+	 *        it is computed once and passed to each access to the cache.
+	 * \param terrain A terrain
+	 * \return The hash of the terrain
+	 */
+	static quint64 terrainHash(const Terrain& terrain);
+
+private:
+	QString m_directory;
+};
+
+}
+
+#endif // HORIZONCACHE_H
@@ -2,7 +2,13 @@
 #define OCCLUSION_H
 
 #include <vector>
+#include <array>
+#include <cstdint>
 #include <bitset>
+#include <variant>
+#include <type_traits>
+
+#include <QRect>
 
 #include "terrain.h"
 #include "terrainviewerparameters.h"
@@ -10,37 +16,482 @@
 namespace TerrainViewer
 {
 
-struct HorizonAngles
+/**
+ * \brief An azimuthal direction in which horizon angles are computed
+ */
+struct HorizonDirection
+{
+	// Step on the I axis (height axis) between two consecutive cells of a sweep line
+	int di;
+	// Step on the J axis (width axis) between two consecutive cells of a sweep line
+	int dj;
+	// Cosine of the azimuth in which the horizon is found, i.e. behind the sweep line
+	float cosine;
+	// Sine of the azimuth in which the horizon is found, i.e. behind the sweep line
+	float sine;
+};
+
+/**
+ * \brief Generate the azimuthal directions at compile time.
+ *        Direction k is the integer step closest to the azimuth 2kpi/n whose coordinates
+ *        are at most max(1, n/8). With 16 directions, these are the 4-connected neighborhood,
+ *        the diagonals and the knight moves in chess.
+ * \tparam N Number of azimuthal directions
+ * \return The azimuthal directions ordered by increasing azimuth
+ */
+template <int N>
+constexpr std::array<HorizonDirection, N> generateHorizonDirections()
 {
+	constexpr double pi = 3.14159265358979323846;
+	constexpr int maxStep = (N / 8 > 1) ? N / 8 : 1;
+
+	std::array<HorizonDirection, N> directions{};
+
+	for (int k = 0; k < N; k++)
+	{
+		// Azimuth between -pi and pi, so that the series converges quickly
+		double azimuth = 2.0 * pi * k / N;
+		if (azimuth > pi)
+		{
+			azimuth -= 2.0 * pi;
+		}
+
+		// Taylor series of the cosine and the sine of the azimuth
+		double cosine = 0.0;
+		double sine = 0.0;
+		double term = 1.0;
+		for (int n = 0; n < 40; n++)
+		{
+			switch (n % 4)
+			{
+			case 0: cosine += term; break;
+			case 1: sine += term; break;
+			case 2: cosine -= term; break;
+			case 3: sine -= term; break;
+			}
+			term *= azimuth / (n + 1);
+		}
+
+		// Find the integer vector (x, y) closest to the azimuth, the shortest one in case of a tie
+		int bestX = 0;
+		int bestY = 0;
+		double bestError = 0.0;
+		for (int x = -maxStep; x <= maxStep; x++)
+		{
+			for (int y = -maxStep; y <= maxStep; y++)
+			{
+				const double dot = x * cosine + y * sine;
+				if (dot <= 0.0)
+				{
+					continue;
+				}
+
+				// Tangent of the angle between the vector and the azimuth
+				const double cross = x * sine - y * cosine;
+				const double error = (cross < 0.0 ? -cross : cross) / dot;
+
+				const bool first = (bestX == 0 && bestY == 0);
+				const bool better = error < bestError - 1e-9;
+				const bool shorter = error < bestError + 1e-9 && x * x + y * y < bestX * bestX + bestY * bestY;
+				if (first || better || shorter)
+				{
+					bestX = x;
+					bestY = y;
+					bestError = error;
+				}
+			}
+		}
+
+		// Norm of the vector with the Newton method
+		const double squaredNorm = bestX * bestX + bestY * bestY;
+		double norm = squaredNorm;
+		for (int n = 0; n < 20; n++)
+		{
+			norm = 0.5 * (norm + squaredNorm / norm);
+		}
+
+		// The horizon is found behind the sweep line, hence the sweep direction is the opposite vector
+		directions[k].di = -bestY;
+		directions[k].dj = -bestX;
+		directions[k].cosine = static_cast<float>(bestX / norm);
+		directions[k].sine = static_cast<float>(bestY / norm);
+	}
+
+	return directions;
+}
+
+/**
+ * \brief Horizon angles of every cell of a terrain in each azimuthal direction.
+ *        Angles are stored in planes: one contiguous array per direction,
+ *        so that each direction can be written and read independently.
+ *        Angles are between 0 and pi/2 and can be quantized on 16 or 8 bits. The quantization
+ *        error on an angle is at most pi/(4 * (2^b - 1)): 1.2e-5 rad on 16 bits, 3.1e-3 rad on 8 bits.
+ *        The error on the uniform light map is at most sqrt(5) times the error on angles
+ *        (2.7e-5 on 16 bits, 6.9e-3 on 8 bits), and on the basic one, before remapping,
+ *        at most 1 / (2 * (2^b - 1)) (7.6e-6 on 16 bits, 2.0e-3 on 8 bits).
+ * \tparam N Number of azimuthal directions, see HorizonDirections for the available presets
+ */
+template <int N>
+class HorizonAngles
+{
+public:
+	static_assert(N >= 4 && N % 4 == 0, "The number of directions must be a multiple of 4");
+
+	// Number of azimuthal directions
+	static constexpr int nbDirections = N;
+
 	// A type to specify which direction is enabled when computing ambient occlusion
-	using EnabledDirections = std::bitset<16>;
+	using EnabledDirections = std::bitset<N>;
 
 	// Horizon angles directions
-	static const std::array<std::pair<int, int>, 16> directions;
+	static constexpr std::array<HorizonDirection, N> directions = generateHorizonDirections<N>();
+
+	HorizonAngles();
+
+	HorizonAngles(int resolutionWidth, int resolutionHeight, HorizonPrecision precision = HorizonPrecision::float32);
+
+	/**
+	 * \brief Return true if there is no horizon angle, false otherwise
+	 * \return True if there is no horizon angle, false otherwise
+	 */
+	bool empty() const;
 
-	// Array of 16 horizon angles value initialized
-	std::array<float, 16> angles{};
+	/**
+	 * \brief Return the resolution on the width axis
+	 * \return The resolution on the width axis
+	 */
+	int resolutionWidth() const;
+
+	/**
+	 * \brief Return the resolution on the height axis
+	 * \return The resolution on the height axis
+	 */
+	int resolutionHeight() const;
+
+	/**
+	 * \brief Return the number of cells in a plane
+	 * \return The number of cells in a plane
+	 */
+	int planeSize() const;
+
+	/**
+	 * \brief Return the storage precision of the angles
+	 * \return The storage precision of the angles
+	 */
+	HorizonPrecision precision() const;
+
+	/**
+	 * \brief Store the horizon angles of consecutive cells in one direction, quantized if needed
+	 * \param direction Index of the azimuthal direction
+	 * \param index Index of the first cell in a row major array
+	 * \param count Number of cells
+	 * \param angles The count angles to store, between 0 and pi/2
+	 */
+	void encode(int direction, int index, int count, const float* angles);
+
+	/**
+	 * \brief Read the horizon angles of consecutive cells in one direction
+	 * \param direction Index of the azimuthal direction
+	 * \param index Index of the first cell in a row major array
+	 * \param count Number of cells
+	 * \param buffer An array of at least count angles, filled if the angles are quantized
+	 * \return A pointer to the count angles, directly in the plane if they are not quantized
+	 */
+	const float* decode(int direction, int index, int count, float* buffer) const;
+
+	/**
+	 * \brief Return the storage of all planes, in the type matching the precision
+	 * \return A pointer to rawDataSize() bytes
+	 */
+	const void* rawData() const;
+
+	/**
+	 * \brief Return the storage of all planes, in the type matching the precision
+	 * \return A pointer to rawDataSize() bytes
+	 */
+	void* rawData();
+
+	/**
+	 * \brief Return the size in bytes of the storage of all planes
+	 * \return The size in bytes of the storage of all planes
+	 */
+	size_t rawDataSize() const;
+
+	/**
+	 * \brief Return the horizon angles of every cell in one direction. Angles must not be quantized.
+	 * \param direction Index of the azimuthal direction
+	 * \return A pointer to planeSize() angles stored in row major order
+	 */
+	const float* plane(int direction) const;
+
+	/**
+	 * \brief Return the horizon angles of every cell in one direction. Angles must not be quantized.
+	 * \param direction Index of the azimuthal direction
+	 * \return A pointer to planeSize() angles stored in row major order
+	 */
+	float* plane(int direction);
+
+	/**
+	 * \brief Get access to the horizon angle of a cell in one direction. Angles must not be quantized.
+	 * \param direction Index of the azimuthal direction
+	 * \param index Index of the cell in a row major array
+	 * \return The horizon angle between 0 and pi/2
+	 */
+	const float& operator()(int direction, int index) const;
+
+	/**
+	 * \brief Get access to the horizon angle of a cell in one direction. Angles must not be quantized.
+	 * \param direction Index of the azimuthal direction
+	 * \param index Index of the cell in a row major array
+	 * \return The horizon angle between 0 and pi/2
+	 */
+	float& operator()(int direction, int index);
+
+private:
+	int m_resolutionWidth;
+	int m_resolutionHeight;
+
+	HorizonPrecision m_precision;
+
+	// Only the array matching the precision is allocated
+	std::vector<float> m_angles;
+	std::vector<uint16_t> m_angles16;
+	std::vector<uint8_t> m_angles8;
 };
 
+/**
+ * \brief Horizon angles with any of the presets of HorizonDirections
+ */
+using AnyHorizonAngles = std::variant<
+	HorizonAngles<4>,
+	HorizonAngles<8>,
+	HorizonAngles<16>,
+	HorizonAngles<32>,
+	HorizonAngles<64>
+>;
+
+/**
+ * \brief Call a function with the number of azimuthal directions of a preset chosen at runtime.
+ *        This is the only place that lists the presets with AnyHorizonAngles and the explicit instantiations.
+ * \param directions The preset for the number of azimuthal directions
+ * \param function Called with std::integral_constant<int, N>, N being the number of azimuthal directions.
+ *                 It must return the same type for every preset.
+ * \return The result of the function
+ */
+template <typename Function>
+auto dispatchHorizonDirections(HorizonDirections directions, Function&& function)
+{
+	switch (directions)
+	{
+	case HorizonDirections::four:
+		return function(std::integral_constant<int, 4>());
+
+	case HorizonDirections::eight:
+		return function(std::integral_constant<int, 8>());
+
+	case HorizonDirections::thirtyTwo:
+		return function(std::integral_constant<int, 32>());
+
+	case HorizonDirections::sixtyFour:
+		return function(std::integral_constant<int, 64>());
+
+	default:
+		return function(std::integral_constant<int, 16>());
+	}
+}
+
+/**
+ * \brief Return the azimuthal directions of a preset chosen at runtime, see HorizonAngles::directions
+ * \param directions The preset for the number of azimuthal directions
+ * \return The azimuthal directions ordered by increasing azimuth
+ */
+std::vector<HorizonDirection> horizonDirections(HorizonDirections directions);
+
+/**
+ * \brief Return true if the terrain is lit by a light map with this shading
+ * \param shading The shading of the terrain
+ * \return False with Shading::normal and Shading::slope, true otherwise
+ */
+bool shadingUsesLightMap(Shading shading);
+
+/**
+ * \brief Return true if a light map with this shading is computed from the horizon angles
+ * \param shading The shading of the terrain
+ * \return True if the light map depends on the horizon angles, false otherwise
+ */
+bool shadingUsesHorizonAngles(Shading shading);
+
+/**
+ * \brief Return the number of channels of a light map with this shading, interleaved in each cell
+ * \param shading The shading of the terrain
+ * \return 3 with Shading::lightChannels, see lightChannels, otherwise 1
+ */
+int lightMapChannels(Shading shading);
+
+/**
+ * \brief Return the channel of the light map that is displayed with the parameters
+ * \param parameters Parameters with the shading and the light channel
+ * \return The index of the channel in each cell, 0 if the light map has only one channel
+ */
+int displayedLightMapChannel(const Parameters& parameters);
+
 /**
  * \brief Compute the horizon angles on a terrain with a fast algorithm.
  *		  See horizonAngleScan
+ *        With a near field radius, the horizon is searched exactly only up to this number of cells,
+ *        and approximated farther on a terrain downsampled by blocks of nearFieldRadius / 8 cells.
+ *        Approximate horizon angles may be lower or higher than the exact ones,
+ *        see multiResolutionHorizonAngles for the measured error.
+ * \tparam N Number of azimuthal directions
  * \param terrain A terrain
+ * \param precision Storage precision of the horizon angles
+ * \param nearFieldRadius Number of cells in the near field, 0 for exact horizon angles
  * \return The horizon angles in each cell of the terrain
  */
-std::vector<HorizonAngles> computeHorizonAngles(const Terrain& terrain);
+template <int N>
+HorizonAngles<N> computeHorizonAngles(const Terrain& terrain,
+									  HorizonPrecision precision = HorizonPrecision::float32,
+									  int nearFieldRadius = 0);
+
+/**
+ * \brief Compute the horizon angles on a terrain with a number of directions chosen at runtime
+ * \param terrain A terrain
+ * \param directions The preset for the number of azimuthal directions
+ * \param precision Storage precision of the horizon angles
+ * \param nearFieldRadius Number of cells in the near field, 0 for exact horizon angles
+ * \return The horizon angles in each cell of the terrain
+ */
+AnyHorizonAngles computeHorizonAngles(const Terrain& terrain,
+									  HorizonDirections directions,
+									  HorizonPrecision precision = HorizonPrecision::float32,
+									  int nearFieldRadius = 0);
+
+/**
+ * \brief Update the horizon angles after the altitudes of the terrain changed in a region.
+ *        Only the sweep lines crossing the region are computed again, and only the cells
+ *        downstream of the region on these sweep lines can change.
+ * \tparam N Number of azimuthal directions
+ * \param terrain The terrain with the new altitudes
+ * \param horizonAngles The horizon angles of the terrain before the change, updated
+ * \param region The cells in which altitudes changed, x is the column and y is the row
+ * \return The bounding rectangle of the cells in which at least one horizon angle changed
+ */
+template <int N>
+QRect updateHorizonAngles(const Terrain& terrain, HorizonAngles<N>& horizonAngles, const QRect& region);
+
+/**
+ * \brief Update the horizon angles after the altitudes of the terrain changed in a region.
+ *        Dispatch to the function specialized for the number of directions of the horizon angles.
+ * \return The bounding rectangle of the cells in which at least one horizon angle changed
+ */
+QRect updateHorizonAngles(const Terrain& terrain, AnyHorizonAngles& horizonAngles, const QRect& region);
+
+template <int N>
+std::vector<float> ambientOcclusionBasic(const Terrain& terrain, const HorizonAngles<N>& horizonAngles);
+
+template <int N>
+std::vector<float> ambientOcclusionUniform(const Terrain& terrain, const HorizonAngles<N>& horizonAngles);
+
+template <int N>
+std::vector<float> ambientOcclusionDirectionalUniform(const Terrain& terrain, const HorizonAngles<N>& horizonAngles);
+
+/**
+ * \brief Compute several lighting channels in a single traversal of the horizon angles.
+ *        Channels are interleaved in each cell, in the order of LightChannel:
+ *        the ambient occlusion with a uniform diffuse light, the same as ambientOcclusionUniform,
+ *        the sky-view factor, i.e. the fraction of the sky hemisphere that is visible from the cell,
+ *        and the ambient light with one bounce on the terrain around, see lightChannelsRegion.
+ * \tparam N Number of azimuthal directions
+ * \param terrain The terrain on which to compute the light
+ * \param horizonAngles Horizon angles of the terrain
+ * \return The 3 channels of each cell of the terrain in a flat array
+ */
+template <int N>
+std::vector<float> lightChannels(const Terrain& terrain, const HorizonAngles<N>& horizonAngles);
 
-std::vector<float> ambientOcclusionBasic(const Terrain& terrain, const std::vector<HorizonAngles>& horizonAngles);
+/**
+ * \brief Compute the ambient occlusion with a uniform diffuse light, like ambientOcclusionUniform,
+ *        but with horizons searched only up to a radius around each cell, so that far mountains do not occlude it.
+ *        The terrain is split in tiles computed in parallel. Each tile copies its altitudes and a halo of radius
+ *        cells around it, so that the search of its cells only reads this local copy. Horizon angles are not stored.
+ * \tparam N Number of azimuthal directions
+ * \param terrain The terrain on which to compute the ambient occlusion
+ * \param radius Distance in cells up to which the horizon is searched, in each direction
+ * \return The occlusion value for each cell of the terrain in a flat array
+ */
+template <int N>
+std::vector<float> localAmbientOcclusion(const Terrain& terrain, int radius);
 
-std::vector<float> ambientOcclusionUniform(const Terrain& terrain, const std::vector<HorizonAngles>& horizonAngles);
+/**
+ * \brief Compute again the light map of Shading::localLight after the altitudes of the terrain changed in a region.
+ *        Only the cells at less than the radius from the region are computed again.
+ * \param terrain The terrain with the new altitudes
+ * \param parameters Parameters with the number of directions and the radius
+ * \param region The cells in which altitudes changed, x is the column and y is the row
+ * \param lightMap The coefficients of the light map, updated
+ * \return The bounding rectangle of the coefficients that were computed again, empty if none
+ */
+QRect updateLocalLightMap(const Terrain& terrain, const Parameters& parameters, const QRect& region, std::vector<float>& lightMap);
 
-std::vector<float> ambientOcclusionDirectionalUniform(const Terrain& terrain, const std::vector<HorizonAngles>& horizonAngles);
+/**
+ * \brief Compute the coefficients of the texture storing the light map.
+ * \return The coefficients of the light map.
+ */
+template <int N>
+std::vector<float> computeLightMap(const Terrain& terrain, const HorizonAngles<N>& horizonAngles, const Parameters& parameters);
 
 /**
  * \brief Compute the coefficients of the texture storing the light map.
+ *        Dispatch to the function specialized for the number of directions of the horizon angles.
+ * \return The coefficients of the light map.
+ */
+std::vector<float> computeLightMap(const Terrain& terrain, const AnyHorizonAngles& horizonAngles, const Parameters& parameters);
+
+/**
+ * \brief Compute again the coefficients of the light map in a region, for instance after updateHorizonAngles.
+ *        The light map of the basic shading is normalized over the whole terrain, hence it is computed again entirely.
+ * \tparam N Number of azimuthal directions
+ * \param terrain The terrain with the new altitudes
+ * \param horizonAngles The horizon angles of the terrain
+ * \param parameters Parameters with the shading
+ * \param region The cells in which the normals or the horizon angles changed
+ * \param lightMap The coefficients of the light map, updated
+ * \return The bounding rectangle of the coefficients that were computed again, empty if none
+ */
+template <int N>
+QRect updateLightMap(const Terrain& terrain,
+					 const HorizonAngles<N>& horizonAngles,
+					 const Parameters& parameters,
+					 const QRect& region,
+					 std::vector<float>& lightMap);
+
+/**
+ * \brief Compute again the coefficients of the light map in a region.
+ *        Dispatch to the function specialized for the number of directions of the horizon angles.
+ * \return The bounding rectangle of the coefficients that were computed again, empty if none
+ */
+QRect updateLightMap(const Terrain& terrain,
+					 const AnyHorizonAngles& horizonAngles,
+					 const Parameters& parameters,
+					 const QRect& region,
+					 std::vector<float>& lightMap);
+
+/**
+ * \brief Compute the coefficients of the texture storing the light map without storing the horizon angles.
+ *        Horizon angles are accumulated in the light map as soon as they are computed,
+ *        hence the peak memory is about twice the size of the terrain.
+ * \tparam N Number of azimuthal directions
+ * \return The coefficients of the light map.
+ */
+template <int N>
+std::vector<float> computeLightMap(const Terrain& terrain, const Parameters& parameters);
+
+/**
+ * \brief Compute the coefficients of the texture storing the light map without storing the horizon angles.
+ *        Dispatch to the function specialized for the number of directions in the parameters.
  * \return The coefficients of the light map.
  */
-std::vector<float> computeLightMap(const Terrain& terrain, const std::vector<HorizonAngles>& horizonAngles, const Parameters& parameters);
+std::vector<float> computeLightMap(const Terrain& terrain, const Parameters& parameters);
 
 }
 
@@ -2,6 +2,8 @@
 #define TERRAIN_H
 
 #include <vector>
+#include <memory>
+#include <string>
 
 #include <QImage>
 #include <QVector3D>
@@ -13,6 +15,38 @@
 namespace TerrainViewer
 {
 
+/**
+ * \brief Type of the altitudes of a terrain in memory and in a binary terrain file, see Terrain::sampleType
+ */
+enum class TerrainSampleType
+{
+	// Altitudes themselves
+	float32 = 0,
+	// Altitudes normalized by the max altitude, on 16 bits unsigned integers. Half the memory of float32,
+	// with a precision of maxAltitude / 65535. They are converted to floats when they are read.
+	uint16 = 1
+};
+
+/**
+ * \brief Order of the altitudes of a terrain in memory, see Terrain::data
+ */
+enum class TerrainLayout
+{
+	// Rows one after the other, as uploaded to the GPU and saved in files
+	rowMajor = 0,
+	// Square tiles of Terrain::tileSize cells in row major order, each tile stored row major.
+	// Cells that are neighbors on any axis are close in memory, and a row of a tile is a cache line.
+	tiled = 1
+};
+
+/**
+ * \brief A height field. Copies of a terrain share the same altitudes, which are copied
+ *        only when a terrain that shares them is modified (copy-on-write). A reference
+ *        returned by a non-const accessor must not be kept while the terrain is copied.
+ *        Altitudes stored on 16 bits are converted to floats the first time the terrain is modified.
+ *        Threads that modify the same terrain concurrently, for instance in an OpenMP loop, must
+ *        call the non-const data() once before, so that the copy is not made by several threads.
+ */
 class Terrain
 {
 public:
@@ -21,32 +55,90 @@ public:
 
 	Terrain(float width, float height, float maxAltitude, int resolutionWidth, int resolutionHeight, std::vector<float> data);
 
+	/**
+	 * \brief Copy a terrain. The altitudes are shared until one of the terrains is modified.
+	 */
+	Terrain(const Terrain& terrain);
+
+	Terrain(Terrain&& terrain) noexcept;
+
+	Terrain& operator=(const Terrain& terrain);
+
+	Terrain& operator=(Terrain&& terrain) noexcept;
+
+	~Terrain();
+
+	/**
+	 * \brief Version of the binary terrain format, files with another version are rejected
+	 */
+	static const quint32 binaryVersion;
+
+	/**
+	 * \brief Number of cells on each side of a tile in the tiled layout
+	 */
+	static constexpr int tileSize = 16;
+
 	/**
 	 * \brief Load a terrain from an image
-	 * \param image A QImage containing the height map
+	 * \param image A QImage containing the height map. Grayscale 8 and 16 bits images are read directly,
+	 *              the gray level of other formats is computed with qGray.
+	 * \return True if successfully loaded, false otherwise
 	 */
 	bool loadFromImage(const QImage& image);
 
 
 	/**
 	 * \brief Load a terrain from an image
-	 * \param image A cv::Mat image containing the height map
+	 * \param image A cv::Mat image containing the height map, with 8 bits or 16 bits unsigned integers
+	 *              normalized by the max altitude, or with 32 bits or 64 bits floats storing the altitudes themselves.
+	 *              The buffer of a continuous image of the sample type (32 bits floats, or 16 bits unsigned integers
+	 *              for uint16) is shared with the terrain until the terrain is modified, the terrain never writes in the image.
+	 *              The caller must not write in the image after loading, it would also modify the terrain and its copies.
+	 *              An image on external memory, not allocated by OpenCV, is copied.
+	 * \param type Type of the altitudes of the terrain in memory
+	 * \return True if successfully loaded, false otherwise
 	 */
-	bool loadFromImage(const cv::Mat& image);
+	bool loadFromImage(const cv::Mat& image, TerrainSampleType type = TerrainSampleType::float32);
 
 	/**
 	 * \brief Save the height-map in a grayscale 8 bits file
 	 * \param filename Name of the file
 	 * \return True if successfully saved, false otherwise
 	 */
-	bool saveInGrayscale8(const std::string& filename);
+	bool saveInGrayscale8(const std::string& filename) const;
 
 	/**
 	 * \brief Save the height-map in a grayscale 16 bits file
 	 * \param filename Name of the file
 	 * \return True if successfully saved, false otherwise
 	 */
-	bool saveInGrayscale16(const std::string& filename);
+	bool saveInGrayscale16(const std::string& filename) const;
+
+	/**
+	 * \brief Save the altitudes themselves in a 32 bits float file, for instance TIFF, PFM or EXR
+	 * \param filename Name of the file
+	 * \return True if successfully saved, false otherwise
+	 */
+	bool saveInFloat32(const std::string& filename) const;
+
+	/**
+	 * \brief Save the terrain in the binary terrain format: a header with the dimensions,
+	 *        the max altitude and the byte order, followed by the altitudes at a page boundary
+	 * \param filename Name of the file
+	 * \param type Type of the altitudes in the file
+	 * \return True if successfully saved, false otherwise
+	 */
+	bool saveBinary(const std::string& filename, TerrainSampleType type = TerrainSampleType::float32) const;
+
+	/**
+	 * \brief Load a terrain saved with saveBinary, with its dimensions, its max altitude and its sample type.
+	 *        Altitudes are mapped in memory: samples() points in the file, nothing is read
+	 *        until it is accessed, and modified altitudes are never written back to the file.
+	 *        Copies of the terrain share the mapping.
+	 * \param filename Name of the file
+	 * \return True if successfully loaded, false otherwise
+	 */
+	bool loadBinary(const std::string& filename);
 
 	/**
 	 * \brief Return true if the terrain contains no data, false otherwise
@@ -86,10 +178,85 @@ public:
 
 	/**
 	 * \brief Returns pointer to the underlying array serving as element storage.
-	 * \return A pointer to the underlying array serving as element storage.
+	 *        The altitudes are in the layout of the terrain, see sampleIndex.
+	 *        The altitudes must be stored as floats, convert the terrain with
+	 *        withSampleType(TerrainSampleType::float32) or use samples otherwise.
+	 * \return A pointer to the underlying array serving as element storage
 	 */
 	const float* data() const;
 
+	/**
+	 * \brief Returns pointer to the underlying array serving as element storage, so that it can be modified.
+	 *        The altitudes are first copied if they are shared with another terrain or if they are read-only,
+	 *        and converted to floats if they are stored on 16 bits. Once it is called, the non-const
+	 *        accessors do not copy the altitudes until the terrain is copied, so they can be used concurrently.
+	 * \return A pointer to the underlying array serving as element storage.
+	 */
+	float* data();
+
+	/**
+	 * \brief Return the altitudes in memory, in the layout of the terrain. Sample is float for float32
+	 *        terrains and uint16_t for uint16 terrains, whose samples are multiplied by sampleScale().
+	 * \return A pointer to the samples of the terrain
+	 */
+	template <typename Sample>
+	const Sample* samples() const;
+
+	/**
+	 * \brief Return the type of the altitudes in memory. Terrains are float32 unless loaded as uint16.
+	 * \return The sample type of the terrain
+	 */
+	TerrainSampleType sampleType() const;
+
+	/**
+	 * \brief Return the altitude of one unit of a sample: the max altitude divided by 65535
+	 *        for uint16 terrains, 1 for float32 terrains
+	 * \return The altitude of one unit of a sample
+	 */
+	float sampleScale() const;
+
+	/**
+	 * \brief Return the terrain with its altitudes stored with another type. If the type is the same,
+	 *        the altitudes are shared and not converted. Altitudes are clamped between 0 and the max
+	 *        altitude and rounded to the closest sample when they are converted to uint16.
+	 * \param type The sample type of the returned terrain
+	 * \return The terrain with the given sample type
+	 */
+	Terrain withSampleType(TerrainSampleType type) const;
+
+	/**
+	 * \brief Return the order of the altitudes in memory. Terrains are loaded row major.
+	 * \return The layout of the terrain
+	 */
+	TerrainLayout layout() const;
+
+	/**
+	 * \brief Return the terrain with its altitudes in another order in memory.
+	 *        If the layout is the same, the altitudes are shared and not converted.
+	 * \param layout The layout of the returned terrain
+	 * \return The terrain with the given layout
+	 */
+	Terrain withLayout(TerrainLayout layout) const;
+
+	/**
+	 * \brief Copy consecutive altitudes of a row in an array, whatever the layout of the terrain
+	 * \param i Y coordinate of the row (height axis)
+	 * \param j X coordinate of the first cell (width axis)
+	 * \param count Number of cells to copy
+	 * \param output The array in which altitudes are copied
+	 */
+	void copyRow(int i, int j, int count, float* output) const;
+
+	/**
+	 * \brief Modify consecutive altitudes of a row, whatever the layout of the terrain.
+	 *        The altitudes are first copied if they are shared, see data(), otherwise only the row is written.
+	 * \param i Y coordinate of the row (height axis)
+	 * \param j X coordinate of the first cell (width axis)
+	 * \param count Number of cells to modify
+	 * \param input The new altitudes of the cells
+	 */
+	void setRow(int i, int j, int count, const float* input);
+
 	/**
 	 * \brief Return the terrain resolution on the width axis
 	 * \return The terrain resolution on the width axis
@@ -110,13 +277,22 @@ public:
 	 */
 	int cellIndex(int i, int j) const;
 
+	/**
+	 * \brief Return the index of the altitude of a cell in data(), which depends on the layout.
+	 *        Defined in the header so that kernels walking the terrain inline it.
+	 * \param i Vertex Y coordinate (height axis)
+	 * \param j Vertex X coordinate (width axis)
+	 * \return The index of the altitude of the cell
+	 */
+	int sampleIndex(int i, int j) const;
+
 	/**
 	 * \brief Get access to the altitude of a vertex
 	 * \param i Vertex Y coordinate (height axis)
 	 * \param j Vertex X coordinate (width axis)
 	 * \return The altitude of the vertex
 	 */
-	const float& operator()(int i, int j) const;
+	float operator()(int i, int j) const;
 	
 	/**
 	 * \brief Get access to the altitude of a vertex
@@ -132,7 +308,7 @@ public:
 	 * \param j Vertex X coordinate (width axis)
 	 * \return The altitude of the vertex
 	 */
-	const float& atClamp(int i, int j) const;
+	float atClamp(int i, int j) const;
 
 	/**
 	 * \brief Get access to the altitude of a vertex. Clamp to edge
@@ -159,6 +335,41 @@ public:
 	QVector3D normal(int i, int j) const;
 
 private:
+	/**
+	 * \brief Allocate new altitudes for the terrain, they are not initialized.
+	 *        The previous altitudes are released if no other terrain shares them.
+	 * \param resolutionWidth Resolution on the width axis
+	 * \param resolutionHeight Resolution on the height axis
+	 * \return A pointer to the new altitudes, of type float or uint16_t
+	 */
+	template <typename Sample>
+	Sample* allocate(int resolutionWidth, int resolutionHeight);
+
+	/**
+	 * \brief Copy the altitudes if they are shared with another terrain or if they are read-only,
+	 *        so that they can be modified. Altitudes stored on 16 bits are converted to floats.
+	 */
+	void detach();
+
+	/**
+	 * \brief Return the altitude of a sample, converted to float if needed
+	 * \param index Index of the sample, see sampleIndex
+	 * \return The altitude of the sample
+	 */
+	float sampleAltitude(int index) const;
+
+	/**
+	 * \brief Return the number of altitudes in memory, tiles on the borders are padded
+	 * \return The number of altitudes in memory
+	 */
+	size_t sampleCount() const;
+
+	/**
+	 * \brief Return the size in bytes of a sample in memory, see sampleType
+	 * \return The size of a sample
+	 */
+	size_t sampleSize() const;
+
 	float m_width;
 	float m_height;
 	float m_maxAltitude;
@@ -166,9 +377,40 @@ private:
 	int m_resolutionWidth;
 	int m_resolutionHeight;
 
-	std::vector<float> m_data;
+	// Altitudes of the terrain, shared between the copies. The pointer also owns the storage
+	// of the altitudes: an array, a vector, the file mapped by loadBinary or an image.
+	std::shared_ptr<void> m_samples;
+	// True if the altitudes are in a buffer that the terrain must not modify, like an image
+	bool m_readOnly;
+	// Type of the elements of m_samples
+	TerrainSampleType m_sampleType;
+
+	TerrainLayout m_layout;
+	// Number of tiles on the width axis in the tiled layout
+	int m_tileColumns;
 };
 
+inline int Terrain::sampleIndex(int i, int j) const
+{
+	if (m_layout == TerrainLayout::tiled)
+	{
+		// Coordinates are positive, unsigned divisions by the tile size are shifts
+		const unsigned int k = i;
+		const unsigned int l = j;
+		const unsigned int tile = (k / tileSize) * m_tileColumns + (l / tileSize);
+
+		return static_cast<int>(tile * tileSize * tileSize + (k % tileSize) * tileSize + (l % tileSize));
+	}
+
+	return i * m_resolutionWidth + j;
+}
+
+template <typename Sample>
+const Sample* Terrain::samples() const
+{
+	return static_cast<const Sample*>(m_samples.get());
+}
+
 }
 
 #endif // TERRAIN_H
\ No newline at end of file
@@ -10,6 +10,8 @@
 namespace TerrainViewer
 {
 
+class TerrainProducts;
+
 /**
  * \brief Compute the normals of the terrain on the CPU.
  * \return An array of 4D vectors. The fourth component is always 0.
@@ -22,18 +24,36 @@ std::vector<QVector4D> computeNormals(const Terrain& terrain);
  */
 QImage normalTextureImage(const Terrain& terrain);
 
+/**
+ * \brief Return an image of the normal texture, from the normals shared in the products of the terrain.
+ * \return A 8 bits RGB image of the normal texture.
+ */
+QImage normalTextureImage(TerrainProducts& products);
+
 /**
  * \brief Return an image of the light map texture.
  * \return A 8 bits grayscale image of the light map texture.
  */
 QImage lightMapTextureImage(const Terrain& terrain, const Parameters& parameters);
 
+/**
+ * \brief Return an image of the light map texture, from the light map shared in the products of the terrain.
+ * \return A 8 bits grayscale image of the light map texture.
+ */
+QImage lightMapTextureImage(TerrainProducts& products, const Parameters& parameters);
+
 /**
  * \brief Return an image of the terrain texture with lighting.
  * \return A 8 bits color image of the terrain texture.
  */
 QImage demTextureImage(const Terrain& terrain, const Parameters& parameters);
 
+/**
+ * \brief Return an image of the terrain texture with lighting, from the light map shared in the products of the terrain.
+ * \return A 8 bits color image of the terrain texture.
+ */
+QImage demTextureImage(TerrainProducts& products, const Parameters& parameters);
+
 }
 
 #endif // TERRAINIMAGES_H
\ No newline at end of file
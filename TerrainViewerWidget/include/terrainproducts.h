@@ -0,0 +1,220 @@
+#ifndef TERRAINPRODUCTS_H
+#define TERRAINPRODUCTS_H
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include <QVector4D>
+#include <QRect>
+
+#include "terrain.h"
+#include "terrainviewerparameters.h"
+#include "occlusion.h"
+#include "horizoncache.h"
+
+namespace TerrainViewer
+{
+
+/**
+ * \brief The products computed by bakeLightMap
+ */
+struct LightMapBake
+{
+	// Horizon angles from which the light map is computed, null if they were not needed.
+	// With Shading::sunLight, they are always set so that they can be displayed.
+	std::shared_ptr<const AnyHorizonAngles> horizonAngles;
+	// The coefficients of the light map, empty if the bake was cancelled
+	std::vector<float> lightMap;
+};
+
+/**
+ * \brief A light map baked on a decimated terrain, displayed until the light map of the terrain is baked
+ */
+struct LightMapPreview
+{
+	// Index of the pass, from 0 for the coarsest preview
+	int pass;
+	// Number of passes of the bake, the last one is the light map of the terrain itself
+	int passes;
+	// Resolution of the decimated terrain on the width axis
+	int resolutionWidth;
+	// Resolution of the decimated terrain on the height axis
+	int resolutionHeight;
+	// The light map of the decimated terrain, and its horizon angles with Shading::sunLight
+	LightMapBake bake;
+};
+
+/**
+ * \brief Called by bakeLightMap each time a preview is baked, in the thread of the bake
+ */
+using LightMapPreviewCallback = std::function<void(LightMapPreview preview)>;
+
+/**
+ * \brief Return the decimation factors of the previews baked before the light map of a terrain,
+ *        from the coarsest to the finest. The coarsest preview has at most 512 cells on each axis,
+ *        and each preview has 4 times more cells on each axis than the previous one.
+ * \param terrain A terrain
+ * \return The decimation factors, empty if the terrain is small enough to be baked directly
+ */
+std::vector<int> lightMapPreviewFactors(const Terrain& terrain);
+
+/**
+ * \brief Decimate a terrain by averaging blocks of cells, its dimensions stay the same
+ * \param terrain A terrain
+ * \param factor Number of cells on each axis of a block, the last blocks can be smaller
+ * \return The decimated terrain
+ */
+Terrain decimateTerrain(const Terrain& terrain, int factor);
+
+/**
+ * \brief Compute a light map and the horizon angles it needs, unless they are in the disk cache.
+ *        It does not modify any shared state, so that it can run in a worker thread.
+ *        If they must be computed on a large terrain, previews are first baked on decimated terrains,
+ *        see lightMapPreviewFactors. Previews are neither cached nor kept in the products.
+ * \param terrain A terrain
+ * \param parameters Parameters with the shading, the number of directions and the precision
+ * \param horizonAngles Horizon angles of the terrain with the number of directions and
+ *                      the precision of the parameters if they are already computed, null otherwise
+ * \param cache The disk cache in which horizon angles and light maps are looked up and saved
+ * \param cancelled Checked between each step, the bake stops as soon as it is set
+ * \param preview Called with each preview, from the coarsest to the finest, no previews are baked if empty
+ * \return The light map and the horizon angles from which it is computed
+ */
+LightMapBake bakeLightMap(const Terrain& terrain,
+						  const Parameters& parameters,
+						  std::shared_ptr<const AnyHorizonAngles> horizonAngles,
+						  const HorizonCache& cache,
+						  const std::atomic<bool>& cancelled,
+						  const LightMapPreviewCallback& preview = LightMapPreviewCallback());
+
+/**
+ * \brief Products derived from a terrain: normals, horizon angles and light maps.
+ *        Each product is computed the first time it is requested and kept until the terrain changes,
+ *        so that the widget and the export functions share them. Horizon angles and light maps
+ *        are also looked up in the disk cache before being computed.
+ *        Only the horizon angles with the last requested number of directions, precision and near field radius are kept,
+ *        light maps are kept for every requested parameters.
+ */
+class TerrainProducts
+{
+public:
+	/**
+	 * \brief Create the products of a terrain
+	 * \param terrain The terrain, it must outlive the products. Call clear() when it changes.
+	 */
+	explicit TerrainProducts(const Terrain& terrain);
+
+	TerrainProducts(const TerrainProducts&) = delete;
+	TerrainProducts& operator=(const TerrainProducts&) = delete;
+
+	/**
+	 * \brief Return the terrain from which products are derived
+	 * \return The terrain from which products are derived
+	 */
+	const Terrain& terrain() const;
+
+	/**
+	 * \brief Return the disk cache in which horizon angles and light maps are looked up
+	 * \return The disk cache
+	 */
+	const HorizonCache& cache() const;
+
+	/**
+	 * \brief Discard all products, they are computed again for the new content of the terrain
+	 */
+	void clear();
+
+	/**
+	 * \brief Return the normals of the terrain, see computeNormals
+	 * \return An array of 4D vectors. The fourth component is always 0.
+	 */
+	const std::vector<QVector4D>& normals();
+
+	/**
+	 * \brief Return the horizon angles of the terrain
+	 * \param directions The preset for the number of azimuthal directions
+	 * \param precision Storage precision of the horizon angles
+	 * \param nearFieldRadius Radius of the near field, 0 for exact horizon angles, see computeHorizonAngles
+	 * \return The horizon angles of the terrain
+	 */
+	const AnyHorizonAngles& horizonAngles(HorizonDirections directions, HorizonPrecision precision, int nearFieldRadius = 0);
+
+	/**
+	 * \brief Return the light map of the terrain, see computeLightMap
+	 * \param parameters Parameters with the shading, the number of directions and the precision
+	 * \return The coefficients of the light map
+	 */
+	const std::vector<float>& lightMap(const Parameters& parameters);
+
+	/**
+	 * \brief Return the horizon angles if they are already computed, without computing them
+	 * \param directions The preset for the number of azimuthal directions
+	 * \param precision Storage precision of the horizon angles
+	 * \param nearFieldRadius Radius of the near field, 0 for exact horizon angles, see computeHorizonAngles
+	 * \return The horizon angles, or null if they are not computed
+	 */
+	std::shared_ptr<const AnyHorizonAngles> findHorizonAngles(HorizonDirections directions,
+															  HorizonPrecision precision,
+															  int nearFieldRadius) const;
+
+	/**
+	 * \brief Return the light map if it is already computed, without computing it
+	 * \param parameters Parameters with the shading, the number of directions and the precision
+	 * \return The coefficients of the light map, or null if it is not computed
+	 */
+	const std::vector<float>* findLightMap(const Parameters& parameters) const;
+
+	/**
+	 * \brief Keep the products of a bake, for instance computed in a worker thread with bakeLightMap
+	 * \param parameters The parameters of the bake
+	 * \param bake The light map and the horizon angles from which it is computed
+	 * \return The coefficients of the light map
+	 */
+	const std::vector<float>& insert(const Parameters& parameters, LightMapBake bake);
+
+	/**
+	 * \brief Update the products after the altitudes of the terrain changed in a region.
+	 *        The horizon angles and the light map of the parameters are updated in place,
+	 *        see updateHorizonAngles and updateLightMap. Other products are discarded.
+	 * \param region The cells in which altitudes changed, x is the column and y is the row
+	 * \param parameters Parameters of the light map to update
+	 * \param lightMapRegion The region of the light map that changed, empty if none
+	 * \return False if the light map of the parameters was not computed or could not be updated,
+	 *         for instance with approximate horizon angles, it must be computed again
+	 */
+	bool update(const QRect& region, const Parameters& parameters, QRect& lightMapRegion);
+
+private:
+	// Light maps by shading, number of directions, precision and near field radius, or radius of the local light
+	using LightMapKey = std::tuple<Shading, HorizonDirections, HorizonPrecision, int>;
+
+	/**
+	 * \brief Return the key of a light map in the memoized light maps
+	 * \param parameters Parameters with the shading, the number of directions and the precision
+	 * \return The key of the light map
+	 */
+	static LightMapKey lightMapKey(const Parameters& parameters);
+
+	const Terrain& m_terrain;
+
+	HorizonCache m_cache;
+
+	bool m_hasNormals;
+	std::vector<QVector4D> m_normals;
+
+	// Shared with the bakes in progress, null if not computed
+	std::shared_ptr<const AnyHorizonAngles> m_horizonAngles;
+	HorizonDirections m_directions;
+	HorizonPrecision m_precision;
+	int m_nearFieldRadius;
+
+	std::map<LightMapKey, std::vector<float>> m_lightMaps;
+};
+
+}
+
+#endif // TERRAINPRODUCTS_H
@@ -24,7 +24,42 @@ enum class Shading
 	uniformLightBasic = 1,
 	uniformLight = 2,
 	directionalLight = 3,
-	slope = 4
+	slope = 4,
+	sunLight = 5,
+	lightChannels = 6,
+	localLight = 7
+};
+
+/**
+ * \brief Channel of the light map displayed with Shading::lightChannels
+ */
+enum class LightChannel
+{
+	ambientOcclusion = 0,
+	skyViewFactor = 1,
+	oneBounce = 2
+};
+
+/**
+ * \brief Number of azimuthal directions in which horizon angles are computed
+ */
+enum class HorizonDirections
+{
+	four = 0,
+	eight = 1,
+	sixteen = 2,
+	thirtyTwo = 3,
+	sixtyFour = 4
+};
+
+/**
+ * \brief Storage precision of the horizon angles
+ */
+enum class HorizonPrecision
+{
+	float32 = 0,
+	uint16 = 1,
+	uint8 = 2
 };
 
 /**
@@ -42,6 +77,51 @@ struct Parameters
 	 */
 	Shading shading;
 
+	/**
+	 * \brief Number of azimuthal directions for the light map
+	 */
+	HorizonDirections horizonDirections;
+
+	/**
+	 * \brief Storage precision of the horizon angles kept for the light map
+	 */
+	HorizonPrecision horizonPrecision;
+
+	/**
+	 * \brief Number of cells around each cell in which the horizon is searched at full resolution,
+	 *        farther it is approximated on a downsampled terrain. 0 for the exact horizon everywhere.
+	 */
+	int horizonNearFieldRadius;
+
+	/**
+	 * \brief Bake the light map with compute shaders, directly in the light map texture.
+	 *        Horizon angles are always exact on the GPU, and the light map is not kept on the CPU.
+	 */
+	bool lightMapOnGpu;
+
+	/**
+	 * \brief Azimuth of the sun with Shading::sunLight, in degrees.
+	 *        0 is along the width axis and 90 along the height axis.
+	 */
+	float sunAzimuth;
+
+	/**
+	 * \brief Elevation of the sun above the horizontal plane with Shading::sunLight, in degrees
+	 */
+	float sunElevation;
+
+	/**
+	 * \brief Channel of the light map displayed with Shading::lightChannels.
+	 *        All channels are in the same light map, changing it does not compute the light map again.
+	 */
+	LightChannel lightChannel;
+
+	/**
+	 * \brief Distance in cells up to which the horizon is searched with Shading::localLight,
+	 *        so that only the terrain around a cell occludes it
+	 */
+	int localLightRadius;
+
 	/**
 	 * \brief Display the terrain as a wire-frame
 	 */
@@ -2,6 +2,7 @@
 #define TERRAINVIEWERWIDGET_H
 
 #include <memory>
+#include <atomic>
 
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
@@ -11,11 +12,12 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLTexture>
 #include <QMatrix4x4>
+#include <QThreadPool>
 
 #include "camera.h"
 #include "terrain.h"
 #include "terrainviewerparameters.h"
-#include "occlusion.h"
+#include "terrainproducts.h"
 #include "watersimulation.h"
 
 QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
@@ -44,6 +46,12 @@ public:
 
 	const Parameters& parameters() const;
 
+	/**
+	 * \brief Return the products derived from the terrain, shared with the export functions
+	 * \return The products derived from the terrain
+	 */
+	TerrainProducts& products();
+
 public slots:
 	void cleanup();
 	void printInfo();
@@ -56,10 +64,28 @@ public slots:
 
 	/**
 	 * \brief Load and display a terrain in the widget. The terrain cannot be empty.
+	 *        The widget shares the altitudes of the terrain, they are not copied.
 	 * \param terrain A non empty terrain.
 	 */
 	void loadTerrain(const Terrain& terrain);
 
+	/**
+	 * \brief Load and display a terrain in the widget. The terrain cannot be empty.
+	 * \param terrain A non empty terrain, moved in the widget.
+	 */
+	void loadTerrain(Terrain&& terrain);
+
+	/**
+	 * \brief Update the altitudes of the loaded terrain in a region, for instance after an edit with a brush.
+	 * Only the horizon angles and the light map affected by the region are computed again,
+	 * and only the changed parts of the textures are uploaded. Only the altitudes of the region are copied
+	 * in the widget, the altitudes outside of the region must not have changed. The first update after
+	 * loadTerrain also copies the whole terrain once, since the widget shares the altitudes of the loaded terrain.
+	 * \param terrain The edited terrain, with the same resolution as the loaded terrain
+	 * \param region The cells in which altitudes changed, x is the column and y is the row
+	 */
+	void updateTerrain(const Terrain& terrain, const QRect& region);
+
 	/**
 	 * \brief Set the camera
 	 * \param camera The new camera
@@ -72,6 +98,17 @@ public slots:
 	 */
 	void setParameters(const Parameters& parameters);
 
+	/**
+	 * \brief Highlight cells of the terrain, for instance the result of viewshed.
+	 * \param mask One byte per cell, row major, see Terrain::cellIndex, 255 to highlight the cell, 0 otherwise
+	 */
+	void setOverlay(const std::vector<uint8_t>& mask);
+
+	/**
+	 * \brief Remove the highlight of the cells
+	 */
+	void clearOverlay();
+
 	/**
 	 * \brief Initialize and start the water simulation
 	 */
@@ -87,6 +124,27 @@ public slots:
 	 */
 	void resumeWaterSimulation();
 
+	/**
+	 * \brief Cancel the bake of the light map in progress, if any.
+	 * The last displayed preview, or the previous light map, stays displayed.
+	 */
+	void cancelLightMapBake();
+
+signals:
+	/**
+	 * \brief Emitted each time a pass of the bake of the light map is displayed.
+	 * Light maps of large terrains are first baked on decimated terrains, see lightMapPreviewFactors.
+	 * \param pass Number of the displayed pass, between 1 and passes
+	 * \param passes Number of passes of the bake, the light map is complete when pass is equal to passes
+	 */
+	void lightMapBakeProgress(int pass, int passes);
+
+	/**
+	 * \brief Emitted when the bake of the light map is cancelled before its last pass,
+	 * by cancelLightMapBake or by a new request
+	 */
+	void lightMapBakeCancelled();
+
 protected:
 	void initializeGL() override;
 	void resizeGL(int w, int h) override;
@@ -104,11 +162,26 @@ private:
 	 */
 	void computeNormalsOnShader();
 
+	/**
+	 * \brief Bake the light map of the current parameters in compute shaders.
+	 * One invocation computes the horizon angles of one sweep line with a convex hull, see computeHorizonAngles,
+	 * and adds the light received by its cells directly to the light map texture, one direction after the other.
+	 * The shading of the parameters must use the horizon angles. Height map texture must be initialized.
+	 */
+	void bakeLightMapOnShader();
+
 	/**
 	 * \brief Initialize the texture storing the height of the terrain.
+	 *        A 16 bits terrain is uploaded as it is stored in a normalized 16 bits texture.
 	 */
 	void initTerrainTexture();
 
+	/**
+	 * \brief Return the factor by which shaders multiply the values read in the height texture
+	 * \return The max altitude if the texture is normalized, 1 otherwise
+	 */
+	float heightTextureScale() const;
+
 	/**
 	 * \brief Initialize the texture storing the normals.
 	 * Compute the normals on the shader based on the height map texture.
@@ -116,10 +189,89 @@ private:
 	 */
 	void initNormalTexture();
 
+	/**
+	 * \brief Initialize the texture storing the light map, without setting its content.
+	 * \param resolutionWidth Resolution of the light map on the width axis
+	 * \param resolutionHeight Resolution of the light map on the height axis
+	 * \param channels Number of channels of the light map, 1 or 3, see lightMapChannels
+	 */
+	void initLightMapTexture(int resolutionWidth, int resolutionHeight, int channels = 1);
+
 	/**
 	 * \brief Initialize the texture storing the light map.
+	 * \param lightMap The coefficients of the light map
+	 * \param resolutionWidth Resolution of the light map on the width axis
+	 * \param resolutionHeight Resolution of the light map on the height axis
+	 * \param channels Number of channels of the light map, 1 or 3, interleaved in each texel
 	 */
-	void initLightMapTexture();
+	void initLightMapTexture(const std::vector<float>& lightMap, int resolutionWidth, int resolutionHeight, int channels = 1);
+
+	/**
+	 * \brief Initialize the texture array storing the horizon angles, one layer per azimuthal direction,
+	 * without setting its content. Quantized angles are stored normalized, i.e. divided by pi/2.
+	 * \param resolutionWidth Resolution of the horizon angles on the width axis
+	 * \param resolutionHeight Resolution of the horizon angles on the height axis
+	 * \param nbDirections Number of azimuthal directions
+	 * \param precision Storage precision of the horizon angles
+	 */
+	void initHorizonTexture(int resolutionWidth, int resolutionHeight, int nbDirections, HorizonPrecision precision);
+
+	/**
+	 * \brief Initialize the texture array storing the horizon angles with a single flat horizon,
+	 * the sun is never occluded.
+	 */
+	void initFlatHorizonTexture();
+
+	/**
+	 * \brief Upload the horizon angles in the texture array, for the sun in the fragment shader.
+	 * The texture is initialized again if its resolution, number of layers or format do not match.
+	 * \param horizonAngles The horizon angles of the terrain
+	 * \param region The region to upload, x is the column and y is the row, the whole texture if empty
+	 */
+	void uploadHorizonTexture(const AnyHorizonAngles& horizonAngles, const QRect& region = QRect());
+
+	/**
+	 * \brief Initialize the texture storing the overlay mask, one byte per cell.
+	 * \param mask The mask, one byte per cell, normalized by the GPU
+	 * \param resolutionWidth Resolution of the mask on the width axis
+	 * \param resolutionHeight Resolution of the mask on the height axis
+	 */
+	void initOverlayTexture(const std::vector<uint8_t>& mask, int resolutionWidth, int resolutionHeight);
+
+	/**
+	 * \brief Upload a region of a texture with one or three floats per texel.
+	 * \param texture The texture, with the same resolution as the terrain
+	 * \param data The values of all texels of the texture
+	 * \param region The region to upload, x is the column and y is the row
+	 * \param channels Number of floats per texel, 1 or 3, interleaved in each texel
+	 */
+	void uploadTextureRegion(QOpenGLTexture& texture, const float* data, const QRect& region, int channels = 1);
+
+	/**
+	 * \brief Display the light map for the current parameters.
+	 * If it is not already computed, it is baked in a worker thread and the current light map
+	 * is displayed until it is ready. A new request cancels the bake in progress.
+	 */
+	void requestLightMap();
+
+	/**
+	 * \brief Receive a preview of the light map baked in the worker thread, in the GUI thread.
+	 * It is uploaded at its own resolution, only if no other light map was requested in the meantime.
+	 * \param request Index of the request of the bake
+	 * \param parameters Parameters of the bake
+	 * \param preview The light map of a decimated terrain, see bakeLightMap
+	 */
+	void showLightMapPreview(int request, const Parameters& parameters, LightMapPreview preview);
+
+	/**
+	 * \brief Receive a light map baked in the worker thread, in the GUI thread.
+	 * It is uploaded only if no other light map was requested in the meantime.
+	 * \param request Index of the request of the bake
+	 * \param parameters Parameters of the bake
+	 * \param passes Number of passes of the bake, this is the last one
+	 * \param bake The light map and the horizon angles from which it is computed
+	 */
+	void finishLightMapBake(int request, const Parameters& parameters, int passes, LightMapBake bake);
 
 	int m_numberPatchesHeight;
 	int m_numberPatchesWidth;
@@ -130,18 +282,37 @@ private:
 	QOpenGLDebugLogger* m_logger;
 	std::unique_ptr<QOpenGLShaderProgram> m_program;
 	std::unique_ptr<QOpenGLShaderProgram> m_computeNormalsProgram;
+	std::unique_ptr<QOpenGLShaderProgram> m_computeHorizonProgram;
+	std::unique_ptr<QOpenGLShaderProgram> m_remapLightMapProgram;
 
 	WaterSimulation m_waterSimulation;
 
 	Terrain m_terrain;
 
-	std::vector<HorizonAngles> m_horizonAngles;
+	TerrainProducts m_products;
+
+	// Copy of the terrain shared with the bakes, so that loadTerrain never waits for them
+	std::shared_ptr<const Terrain> m_bakeTerrain;
+	// Index of the last light map request, results of older requests are discarded
+	int m_bakeRequest;
+	// Set to cancel the bake of the last request
+	std::shared_ptr<std::atomic<bool>> m_bakeCancelled;
+	// Worker thread baking the light maps, one at a time
+	QThreadPool m_bakeThreadPool;
 
 	QOpenGLVertexArrayObject m_vao;
 	QOpenGLBuffer m_vbo;
 	QOpenGLTexture m_heightTexture;
 	QOpenGLTexture m_normalTexture;
 	QOpenGLTexture m_lightMapTexture;
+	// Horizon angles of the displayed light map, one layer per direction, to light the terrain with the sun
+	QOpenGLTexture m_horizonTexture;
+	// Mask of the highlighted cells, for instance a viewshed, and whether it is displayed
+	QOpenGLTexture m_overlayTexture;
+	bool m_overlayEnabled;
+	// Shader storage buffers of the GPU bake: convex hulls of the sweep lines, range of the light map
+	GLuint m_horizonHullBuffer;
+	GLuint m_lightMapRangeBuffer;
 
 	OrbitCamera m_camera;
 };
@@ -26,6 +26,14 @@ public:
 	QOpenGLTexture& waterMapTexture();
 
 	void initSimulation(QOpenGLContext* context, const Terrain& terrain);
+
+	/**
+	 * \brief Update the altitudes of the terrain in a region, the water map is kept.
+	 *        Only the region is uploaded to the height texture.
+	 * \param region The cells in which altitudes changed, x is the column and y is the row
+	 * \param altitudes The new altitudes of the region, row major
+	 */
+	void updateTerrain(const QRect& region, const float* altitudes);
 	
 	void computeIteration(QOpenGLContext* context);
 
@@ -79,6 +87,7 @@ public:
 
 private:
 	void initComputeShader();
+	void initHeightTexture();
 	void initTextures();
 
 	bool m_running;
@@ -0,0 +1,194 @@
+#version 430
+
+// One invocation per sweep line
+layout (local_size_x = 64) in;
+
+// Altitudes, normalized if the terrain stores them on 16 bits
+layout (binding = 0) uniform sampler2D heightmap;
+layout (r32f, binding = 1) uniform image2D lightmap;
+// Horizon angles, one layer per direction, in any of the formats of the precisions
+layout (binding = 2) uniform writeonly image2DArray horizons;
+
+// Convex hull of each sweep line of the dispatch: position on the sweep line and altitude of its points
+layout (std430, binding = 0) buffer HullBuffer
+{
+	vec2 hull[];
+};
+
+uniform float terrain_height;
+uniform float terrain_width;
+
+// Multiplies the altitudes read in the height map, the max altitude if they are normalized
+uniform float height_scale;
+
+// Step between two consecutive cells of a sweep line, x on the J axis and y on the I axis
+uniform ivec2 direction;
+// Cosine and sine of the azimuth in which the horizon is found
+uniform vec2 azimuth;
+
+// Index of the sweep line of the first invocation, and number of sweep lines in the direction
+uniform int first_sweep;
+uniform int sweep_count;
+// Number of points in the convex hull of each invocation
+uniform int hull_capacity;
+
+// Shading of the light map: 0 for the basic uniform light, otherwise the light with the normals
+uniform int shading;
+uniform int nb_directions;
+// Light intensity divided by the number of directions, and times sin(pi/n) / pi
+uniform float normal_weight;
+uniform float projection_weight;
+// If false, the light map is overwritten, for the first direction
+uniform bool accumulate;
+
+// If true, the horizon angles divided by horizon_scale are stored in the layer of the direction
+uniform bool store_horizons;
+uniform float horizon_scale;
+uniform int horizon_layer;
+
+const float PI_2 = 1.57079632679489661923;
+
+// Return the first cell (j, i) of a sweep line and its length, see horizonSweepStart
+ivec2 sweepStart(int sweep, ivec2 terrainSize, out int length)
+{
+	const int aj = abs(direction.x);
+	const int ai = abs(direction.y);
+
+	// Coordinates of the first cell as if the direction was positive on both axes
+	ivec2 start;
+	if (sweep < ai * terrainSize.x)
+	{
+		start = ivec2(sweep % terrainSize.x, sweep / terrainSize.x);
+	}
+	else
+	{
+		start = ivec2((sweep - ai * terrainSize.x) % aj, ai + (sweep - ai * terrainSize.x) / aj);
+	}
+
+	// Number of steps until the sweep line leaves the terrain
+	length = max(terrainSize.x, terrainSize.y);
+	if (ai > 0)
+	{
+		length = min(length, (terrainSize.y - 1 - start.y) / ai + 1);
+	}
+	if (aj > 0)
+	{
+		length = min(length, (terrainSize.x - 1 - start.x) / aj + 1);
+	}
+
+	// Mirror the coordinates for negative directions
+	return ivec2((direction.x < 0) ? (terrainSize.x - 1 - start.x) : start.x,
+				 (direction.y < 0) ? (terrainSize.y - 1 - start.y) : start.y);
+}
+
+// Normalized normal of a cell, see Terrain::normal
+vec3 cellNormal(ivec2 coords, ivec2 terrainSize)
+{
+	vec3 normal = vec3(0.0, 0.0, 1.0);
+
+	if (all(greaterThan(coords, ivec2(0, 0))) && all(lessThan(coords, terrainSize - ivec2(1, 1))))
+	{
+		const float top = texelFetch(heightmap, coords + ivec2(0, -1), 0).r * height_scale;
+		const float bottom = texelFetch(heightmap, coords + ivec2(0, 1), 0).r * height_scale;
+		const float left = texelFetch(heightmap, coords + ivec2(-1, 0), 0).r * height_scale;
+		const float right = texelFetch(heightmap, coords + ivec2(1, 0), 0).r * height_scale;
+
+		const float stepX = terrain_width / (terrainSize.x - 1);
+		const float stepY = terrain_height / (terrainSize.y - 1);
+
+		const float xDiff = (right - left) / (2.0 * stepX);
+		const float yDiff = (bottom - top) / (2.0 * stepY);
+
+		normal = vec3(-xDiff, -yDiff, 1.0);
+	}
+
+	return normalize(normal);
+}
+
+// Light received by a cell in this direction, see computeOcclusionBasic and uniformLightContribution
+float lightContribution(ivec2 coords, ivec2 terrainSize, float angleZenith)
+{
+	if (shading == 0)
+	{
+		// Percentage of the surface of the hemisphere that is accessible by uniform ambient light
+		return angleZenith / (nb_directions * PI_2);
+	}
+
+	const vec3 normal = cellNormal(coords, terrainSize);
+
+	// Normal projected on the azimuthal direction
+	const float projectionNormal = dot(normal.xy, azimuth);
+
+	// Clamp the angleZenith with the normal so that dot(N, e) >= 0
+	const float theta = min(angleZenith, PI_2 + atan(projectionNormal / normal.z));
+	const float sinTheta = sin(theta);
+
+	return normal_weight * normal.z * sinTheta * sinTheta
+		 + projection_weight * (theta - 0.5 * sin(2.0 * theta)) * projectionNormal;
+}
+
+// Sweep one line of cells in the direction, maintain the convex hull of the cells behind
+// the current one, and add the light received by each cell to the light map, see horizonAngleSweep
+void main()
+{
+	const int sweep = first_sweep + int(gl_GlobalInvocationID.x);
+	if (sweep >= sweep_count)
+	{
+		return;
+	}
+
+	const ivec2 terrainSize = textureSize(heightmap, 0);
+
+	// Distance between two consecutive cells on a sweep line, in the units of the terrain
+	const vec2 cellSize = vec2(terrain_width / terrainSize.x, terrain_height / terrainSize.y);
+	const float stepLength = length(vec2(direction) * cellSize);
+
+	// Points of the convex hull of this sweep line
+	const int hullOffset = int(gl_GlobalInvocationID.x) * hull_capacity;
+	int hullSize = 0;
+
+	int sweepLength;
+	ivec2 coords = sweepStart(sweep, terrainSize, sweepLength);
+	for (int step = 0; step < sweepLength; step++, coords += direction)
+	{
+		const float h = texelFetch(heightmap, coords, 0).r * height_scale;
+
+		// The last point is hidden by the penultimate one if the slope to it is lower
+		while (hullSize > 1)
+		{
+			const vec2 last = hull[hullOffset + hullSize - 1];
+			const vec2 penultimate = hull[hullOffset + hullSize - 2];
+
+			if ((last.y - h) * (step - penultimate.x) >= (penultimate.y - h) * (step - last.x))
+			{
+				break;
+			}
+			hullSize--;
+		}
+
+		// Tangent of the horizon angle, cannot be < 0 because at infinity, the angle with the horizon is 0
+		float slopeHorizon = 0.0;
+		if (hullSize > 0)
+		{
+			const vec2 horizon = hull[hullOffset + hullSize - 1];
+			slopeHorizon = max((horizon.y - h) / ((step - horizon.x) * stepLength), 0.0);
+		}
+
+		const float angleZenith = PI_2 - atan(slopeHorizon);
+		if (store_horizons)
+		{
+			imageStore(horizons, ivec3(coords, horizon_layer), vec4(angleZenith / horizon_scale, 0.0, 0.0, 1.0));
+		}
+
+		float light = lightContribution(coords, terrainSize, angleZenith);
+		if (accumulate)
+		{
+			light += imageLoad(lightmap, coords).r;
+		}
+		imageStore(lightmap, coords, vec4(light, 0.0, 0.0, 1.0));
+
+		// Add the current point to the convex hull
+		hull[hullOffset + hullSize] = vec2(step, h);
+		hullSize++;
+	}
+}
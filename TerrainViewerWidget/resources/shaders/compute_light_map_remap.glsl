@@ -0,0 +1,62 @@
+#version 430
+
+layout (local_size_x = 4, local_size_y = 4) in;
+
+layout (r32f, binding = 1) uniform image2D lightmap;
+
+// Bits of the minimum and the maximum of the light map. Values are positive,
+// hence the order of their bits as unsigned integers is the order of the values.
+layout (std430, binding = 1) buffer RangeBuffer
+{
+	uint minimum;
+	uint maximum;
+};
+
+// If false, find the minimum and the maximum of the light map, otherwise remap it between 0 and 1
+uniform bool remap;
+
+shared uint groupMinimum;
+shared uint groupMaximum;
+
+// Remap the light map between 0 and 1 in two passes, see remapOcclusion
+void main()
+{
+	const ivec2 lightMapSize = imageSize(lightmap);
+	const ivec2 coords = ivec2(gl_GlobalInvocationID);
+	const bool inside = all(lessThan(coords, lightMapSize));
+
+	if (remap)
+	{
+		if (inside)
+		{
+			const float lower = uintBitsToFloat(minimum);
+			const float upper = uintBitsToFloat(maximum);
+			const float value = imageLoad(lightmap, coords).r;
+
+			imageStore(lightmap, coords, vec4((value - lower) / (upper - lower), 0.0, 0.0, 1.0));
+		}
+		return;
+	}
+
+	// Reduce in the work group first, so that there is only one global atomic operation per group
+	if (gl_LocalInvocationIndex == 0)
+	{
+		groupMinimum = 0xFFFFFFFFu;
+		groupMaximum = 0u;
+	}
+	barrier();
+
+	if (inside)
+	{
+		const uint value = floatBitsToUint(imageLoad(lightmap, coords).r);
+		atomicMin(groupMinimum, value);
+		atomicMax(groupMaximum, value);
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		atomicMin(minimum, groupMinimum);
+		atomicMax(maximum, groupMaximum);
+	}
+}
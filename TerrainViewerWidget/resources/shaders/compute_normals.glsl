@@ -2,23 +2,24 @@
 
 layout (local_size_x = 4, local_size_y = 4) in;
 
-layout (r32f, binding = 0) uniform image2D heightmap;
+layout (binding = 0) uniform sampler2D heightmap;
 layout (r32f, binding = 1) uniform image2D watermap;
 layout (rgba32f, binding = 2) uniform image2D normals;
 
 uniform float terrain_height;
 uniform float terrain_width;
+uniform float height_scale;
 
 float altitude(ivec2 coords)
 {
-	return imageLoad(heightmap, coords).r + imageLoad(watermap, coords).r;
+	return texelFetch(heightmap, coords, 0).r * height_scale + imageLoad(watermap, coords).r;
 }
 
 // Compute the normals in heightmap and output the result in normals
 void main()
 {
 	// Resolution of the terrain
-	const ivec2 terrainSize = imageSize(heightmap);
+	const ivec2 terrainSize = textureSize(heightmap, 0);
 	const ivec2 normalMapSize = imageSize(normals);
 
 	// Coordinates on the terrain
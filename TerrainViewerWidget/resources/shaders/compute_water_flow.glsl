@@ -2,7 +2,7 @@
 
 layout (local_size_x = 4, local_size_y = 4) in;
 
-layout (r32f, binding = 0) uniform image2D heightmap;
+layout (binding = 0) uniform sampler2D heightmap;
 layout (r32f, binding = 1) uniform image2D watermap;
 
 // Out flow in the 4 directions, each chanel stores one direction.
@@ -14,6 +14,7 @@ layout (rgba32f, binding = 2) uniform image2D outflow;
 
 uniform float terrain_height;
 uniform float terrain_width;
+uniform float height_scale;
 
 uniform float time_step;
 uniform float water_increment;
@@ -23,7 +24,7 @@ uniform bool bounce_boundaries;
 
 float height(const ivec2 coords)
 {
-	return imageLoad(heightmap, coords).r;
+	return texelFetch(heightmap, coords, 0).r * height_scale;
 }
 
 float water(const ivec2 coords)
@@ -71,7 +72,7 @@ void main()
 {
 	// Resolution of the maps
 	const ivec2 origin = ivec2(0, 0);
-	const ivec2 terrain_size = imageSize(heightmap);
+	const ivec2 terrain_size = textureSize(heightmap, 0);
 	const ivec2 watermap_size = imageSize(watermap);
 	const ivec2 outflow_size = imageSize(outflow);
 
@@ -6,11 +6,18 @@ uniform struct Terrain
 	sampler2D normal_texture;
 	sampler2D lightMap_texture;
 	sampler2D waterMap_texture;
+	// Horizon angles, one layer per azimuthal direction, normalized if they are quantized
+	sampler2DArray horizon_texture;
+	int horizon_directions;
+	// Mask of the highlighted cells, for instance a viewshed
+	sampler2D overlay_texture;
+	float horizon_scale;
 	float height;
 	float width;
 	int resolution_height;
 	int resolution_width;
 	float max_altitude;
+	float height_scale;
 } terrain;
 
 // Minimum depth to display shallow water
@@ -24,6 +31,22 @@ const vec3 light_direction = normalize(vec3(1.0, 1.0, 1.0));
 
 const float waterShininess = 800.0;
 
+const float PI = 3.14159265358979323846;
+const float PI_2 = 1.57079632679489661923;
+
+// Half of the angle in which the sun is partially occluded, also hides the quantization of the horizon angles
+const float SunAngularRadius = 0.01;
+
+// Azimuth and elevation of the sun in radians
+uniform float sun_azimuth;
+uniform float sun_elevation;
+
+// If true, cells of the overlay mask are highlighted
+uniform bool overlay_enabled = false;
+
+// Color of the highlighted cells
+const vec3 OverlayColor = vec3(1.0, 0.4, 0.0);
+
 // Position of the eye in the world
 uniform vec3 eye_world;
 
@@ -39,8 +62,14 @@ const int ShadingUniformLightBasic = 1;
 const int ShadingUniformLight = 2;
 const int ShadingDirectionalLight = 3;
 const int ShadingSlope = 4;
+const int ShadingSunLight = 5;
+const int ShadingLightChannels = 6;
+const int ShadingLocalLight = 7;
 uniform int shading = ShadingNormal;
 
+// Channel of the light map: ambient occlusion, sky-view factor or one bounce with ShadingLightChannels
+uniform int light_channel = 0;
+
 // Varying variables
 in vec3 position_model;
 in vec3 position_world;
@@ -224,7 +253,31 @@ float compute_slope()
 float compute_occlusion()
 {
 	const vec2 texcoord = vec2(position_model.x / terrain.width, position_model.y / terrain.height);
-	return texture(terrain.lightMap_texture, texcoord).s;
+	return texture(terrain.lightMap_texture, texcoord)[light_channel];
+}
+
+// Return the fraction of the sun visible from the fragment, between 0.0 and 1.0
+float compute_sun_visibility()
+{
+	const vec2 texcoord = vec2(position_model.x / terrain.width, position_model.y / terrain.height);
+
+	// Direction k of the horizon angles is at the azimuth 2 * k * pi / n, interpolate between the two around the sun
+	const float direction = mod(sun_azimuth / (2.0 * PI) * terrain.horizon_directions, float(terrain.horizon_directions));
+	const float previous = floor(direction);
+	const float next = mod(previous + 1.0, float(terrain.horizon_directions));
+
+	const float previousAngle = texture(terrain.horizon_texture, vec3(texcoord, previous)).s;
+	const float nextAngle = texture(terrain.horizon_texture, vec3(texcoord, next)).s;
+	const float angleZenith = terrain.horizon_scale * mix(previousAngle, nextAngle, direction - previous);
+
+	// The sun is visible if its angle with the zenith is lower than the one of the horizon
+	return smoothstep(-SunAngularRadius, SunAngularRadius, angleZenith - (PI_2 - sun_elevation));
+}
+
+float compute_overlay()
+{
+	const vec2 texcoord = vec2(position_model.x / terrain.width, position_model.y / terrain.height);
+	return texture(terrain.overlay_texture, texcoord).s;
 }
 
 float compute_water()
@@ -328,6 +381,35 @@ vec3 shading_occlusion()
 	return color;
 }
 
+vec3 shading_sun()
+{
+	// Normalized altitude
+	const float normalized_altitude = compute_normalized_altitude();
+	const float slope = compute_slope();
+	// Light of the sky, the light map is the same as with the uniform light
+	const float occlusion = compute_occlusion();
+	const float water = compute_water();
+	vec3 color = compute_color(normalized_altitude, slope, occlusion, water);
+
+	// Shading of water, specular
+	if (water > ShallowWater)
+	{
+		color = color * water_specular_lighting();
+	}
+	// Shading of terrain, light of the sky and of the sun if it is above the horizon
+	else
+	{
+		const vec3 sun_direction = vec3(cos(sun_elevation) * cos(sun_azimuth),
+										cos(sun_elevation) * sin(sun_azimuth),
+										sin(sun_elevation));
+		const float sun_term = max(0.0, dot(normal_world, sun_direction)) * compute_sun_visibility();
+
+		color = color * (0.25 * occlusion + 0.75 * sun_term);
+	}
+
+	return color;
+}
+
 // Compute the shading of the fragment by choosing
 // the right shading function
 vec3 compute_shading()
@@ -341,12 +423,18 @@ vec3 compute_shading()
 	case ShadingUniformLightBasic:
 	case ShadingUniformLight:
 	case ShadingDirectionalLight:
+	case ShadingLightChannels:
+	case ShadingLocalLight:
 		return shading_occlusion();
 	break;
 
 	case ShadingSlope:
 		return shading_slope();
 		break;
+
+	case ShadingSunLight:
+		return shading_sun();
+		break;
 	}
 
 	// Default shading
@@ -356,5 +444,12 @@ vec3 compute_shading()
 void main()
 {
 	vec3 color = compute_shading();
+
+	// Highlight the cells of the overlay, the shading stays visible below
+	if (overlay_enabled)
+	{
+		color = mix(color, OverlayColor, 0.5 * compute_overlay());
+	}
+
 	fragColor = vec4(color, 1.0);
 }
@@ -11,6 +11,8 @@ uniform struct Terrain
 	int resolution_height;
 	int resolution_width;
 	float max_altitude;
+	// Multiplies the altitudes of the height texture, the max altitude if they are normalized
+	float height_scale;
 } terrain;
 
 layout(location = 0) in vec3 pos_attrib;
@@ -18,7 +20,7 @@ layout(location = 0) in vec3 pos_attrib;
 float height(const vec2 p)
 {
 	const vec2 texcoord = vec2(p.x / terrain.width, p.y / terrain.height);
-	const float terrain_height = texture(terrain.height_texture, texcoord).s;
+	const float terrain_height = texture(terrain.height_texture, texcoord).s * terrain.height_scale;
 	const float water_height = texture(terrain.waterMap_texture, texcoord).s;
 	return terrain_height + water_height;
 }
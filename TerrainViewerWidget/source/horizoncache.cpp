@@ -0,0 +1,431 @@
+#include "horizoncache.h"
+
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+using namespace TerrainViewer;
+
+const quint32 HorizonCache::version = 3;
+
+/**
+ * \brief Type of data stored in an entry of the cache
+ */
+enum class HorizonCacheEntry : quint32
+{
+	horizonAngles = 0,
+	lightMap = 1
+};
+
+/**
+ * \brief Header at the beginning of each file of the cache.
+ *        An entry is valid only if its header is exactly the expected one.
+ */
+struct HorizonCacheHeader
+{
+	// Identifies the files of the cache: "TVHC"
+	char magic[4];
+	// Version of the file format
+	quint32 version;
+	// Type of data in the entry
+	quint32 entry;
+	// Number of azimuthal directions
+	qint32 nbDirections;
+	// Storage precision of the horizon angles
+	qint32 precision;
+	// Shading of the light map, -1 for horizon angles
+	qint32 shading;
+	// Dimensions of the terrain
+	qint32 resolutionWidth;
+	qint32 resolutionHeight;
+	float width;
+	float height;
+	float maxAltitude;
+	// Radius of the near field of the horizon angles, 0 if they are exact
+	qint32 nearFieldRadius;
+	// Hash of the terrain data and dimensions
+	quint64 terrainHash;
+	// Size in bytes of the data following the header
+	quint64 payloadSize;
+};
+
+/**
+ * \brief Build the header of an entry of the cache
+ * \param terrain The terrain of the entry
+ * \param terrainHash The hash of the terrain, see HorizonCache::terrainHash
+ * \param entry Type of data in the entry
+ * \param nbDirections Number of azimuthal directions
+ * \param precision Storage precision of the horizon angles
+ * \param nearFieldRadius Radius of the near field of the horizon angles, 0 if they are exact
+ * \param shading Shading of the light map, -1 for horizon angles
+ * \param payloadSize Size in bytes of the data following the header
+ * \return The header of the entry
+ */
+HorizonCacheHeader horizonCacheHeader(const Terrain& terrain,
+									  quint64 terrainHash,
+									  HorizonCacheEntry entry,
+									  int nbDirections,
+									  HorizonPrecision precision,
+									  int nearFieldRadius,
+									  int shading,
+									  quint64 payloadSize)
+{
+	HorizonCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+
+	std::memcpy(header.magic, "TVHC", sizeof(header.magic));
+	header.version = HorizonCache::version;
+	header.entry = static_cast<quint32>(entry);
+	header.nbDirections = nbDirections;
+	header.precision = static_cast<qint32>(precision);
+	header.nearFieldRadius = nearFieldRadius;
+	header.shading = shading;
+	header.resolutionWidth = terrain.resolutionWidth();
+	header.resolutionHeight = terrain.resolutionHeight();
+	header.width = terrain.width();
+	header.height = terrain.height();
+	header.maxAltitude = terrain.maxAltitude();
+	header.terrainHash = terrainHash;
+	header.payloadSize = payloadSize;
+
+	return header;
+}
+
+/**
+ * \brief Return the path of the file of an entry of the cache
+ * \param directory The directory of the cache
+ * \param header The header of the entry
+ * \return The path of the file of the entry
+ */
+QString horizonCacheEntryPath(const QString& directory, const HorizonCacheHeader& header)
+{
+	QString name = QString("%1-n%2-p%3-r%4")
+		.arg(header.terrainHash, 16, 16, QLatin1Char('0'))
+		.arg(header.nbDirections)
+		.arg(header.precision)
+		.arg(header.nearFieldRadius);
+
+	if (header.entry == static_cast<quint32>(HorizonCacheEntry::lightMap))
+	{
+		name += QString("-s%1.lightmap").arg(header.shading);
+	}
+	else
+	{
+		name += ".horizon";
+	}
+
+	return QDir(directory).filePath(name);
+}
+
+/**
+ * \brief Read an entry of the cache with memory mapping
+ * \param directory The directory of the cache
+ * \param header The expected header of the entry
+ * \param payload A buffer of header.payloadSize bytes, filled with the data of the entry
+ * \return True if the entry exists and its header matches, false otherwise
+ */
+bool readHorizonCacheEntry(const QString& directory, const HorizonCacheHeader& header, void* payload)
+{
+	QFile file(horizonCacheEntryPath(directory, header));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+
+	if (static_cast<quint64>(file.size()) != sizeof(HorizonCacheHeader) + header.payloadSize)
+	{
+		return false;
+	}
+
+	uchar* memory = file.map(0, file.size());
+	if (memory == nullptr)
+	{
+		return false;
+	}
+
+	// Stale entries from another version or another terrain are rejected
+	const bool valid = (std::memcmp(memory, &header, sizeof(HorizonCacheHeader)) == 0);
+	if (valid)
+	{
+		std::memcpy(payload, memory + sizeof(HorizonCacheHeader), header.payloadSize);
+	}
+
+	file.unmap(memory);
+
+	return valid;
+}
+
+/**
+ * \brief Write an entry of the cache. The file is replaced atomically,
+ *        so that another instance never reads a partially written entry.
+ * \param directory The directory of the cache
+ * \param header The header of the entry
+ * \param payload The header.payloadSize bytes of data of the entry
+ * \return True if the entry was written, false otherwise
+ */
+bool writeHorizonCacheEntry(const QString& directory, const HorizonCacheHeader& header, const void* payload)
+{
+	if (!QDir().mkpath(directory))
+	{
+		return false;
+	}
+
+	QSaveFile file(horizonCacheEntryPath(directory, header));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(HorizonCacheHeader));
+	file.write(static_cast<const char*>(payload), header.payloadSize);
+
+	return file.commit();
+}
+
+/**
+ * \brief Read 8 bytes of a buffer as an integer
+ * \param data The buffer, with no alignment requirements
+ * \return The integer
+ */
+quint64 readUint64(const uchar* data)
+{
+	quint64 value;
+	std::memcpy(&value, data, sizeof(value));
+
+	return value;
+}
+
+/**
+ * \brief Read 4 bytes of a buffer as an integer
+ * \param data The buffer, with no alignment requirements
+ * \return The integer
+ */
+quint32 readUint32(const uchar* data)
+{
+	quint32 value;
+	std::memcpy(&value, data, sizeof(value));
+
+	return value;
+}
+
+quint64 rotateLeft(quint64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Primes of XXH64
+const quint64 xxhPrime1 = 11400714785074694791ULL;
+const quint64 xxhPrime2 = 14029467366897019727ULL;
+const quint64 xxhPrime3 = 1609587929392839161ULL;
+const quint64 xxhPrime4 = 9650029242287828579ULL;
+const quint64 xxhPrime5 = 2870177450012600261ULL;
+
+quint64 xxh64Round(quint64 accumulator, quint64 input)
+{
+	accumulator += input * xxhPrime2;
+	accumulator = rotateLeft(accumulator, 31);
+
+	return accumulator * xxhPrime1;
+}
+
+quint64 xxh64MergeRound(quint64 accumulator, quint64 value)
+{
+	accumulator ^= xxh64Round(0, value);
+
+	return accumulator * xxhPrime1 + xxhPrime4;
+}
+
+/**
+ * \brief Compute the XXH64 hash of a buffer. Unlike qHash, its result is specified and does not change
+ *        with the version of Qt, it can be stored in files.
+ * \param data The buffer
+ * \param size Size of the buffer in bytes
+ * \param seed The seed of the hash, for instance the hash of the previous data
+ * \return The hash of the buffer
+ */
+quint64 xxh64(const void* data, size_t size, quint64 seed)
+{
+	const uchar* p = static_cast<const uchar*>(data);
+	const uchar* const end = p + size;
+	quint64 hash;
+
+	if (size >= 32)
+	{
+		quint64 v1 = seed + xxhPrime1 + xxhPrime2;
+		quint64 v2 = seed + xxhPrime2;
+		quint64 v3 = seed;
+		quint64 v4 = seed - xxhPrime1;
+
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = xxh64Round(v1, readUint64(p));
+			v2 = xxh64Round(v2, readUint64(p + 8));
+			v3 = xxh64Round(v3, readUint64(p + 16));
+			v4 = xxh64Round(v4, readUint64(p + 24));
+		}
+
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = xxh64MergeRound(hash, v1);
+		hash = xxh64MergeRound(hash, v2);
+		hash = xxh64MergeRound(hash, v3);
+		hash = xxh64MergeRound(hash, v4);
+	}
+	else
+	{
+		hash = seed + xxhPrime5;
+	}
+
+	hash += size;
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= xxh64Round(0, readUint64(p));
+		hash = rotateLeft(hash, 27) * xxhPrime1 + xxhPrime4;
+	}
+
+	if (p + 4 <= end)
+	{
+		hash ^= readUint32(p) * xxhPrime1;
+		hash = rotateLeft(hash, 23) * xxhPrime2 + xxhPrime3;
+		p += 4;
+	}
+
+	for (; p < end; p++)
+	{
+		hash ^= *p * xxhPrime5;
+		hash = rotateLeft(hash, 11) * xxhPrime1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= xxhPrime2;
+	hash ^= hash >> 29;
+	hash *= xxhPrime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+/**
+ * \brief Allocate horizon angles with a number of directions chosen at runtime
+ * \param directions The preset for the number of azimuthal directions
+ * \param resolutionWidth Resolution on the width axis
+ * \param resolutionHeight Resolution on the height axis
+ * \param precision Storage precision of the horizon angles
+ * \return The horizon angles, all set to 0
+ */
+AnyHorizonAngles allocateHorizonAngles(HorizonDirections directions,
+									   int resolutionWidth,
+									   int resolutionHeight,
+									   HorizonPrecision precision)
+{
+	return dispatchHorizonDirections(directions, [&](auto n) -> AnyHorizonAngles {
+		return HorizonAngles<decltype(n)::value>(resolutionWidth, resolutionHeight, precision);
+	});
+}
+
+TerrainViewer::HorizonCache::HorizonCache() :
+	HorizonCache(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("horizon"))
+{
+}
+
+TerrainViewer::HorizonCache::HorizonCache(const QString& directory) :
+	m_directory(directory)
+{
+}
+
+const QString& TerrainViewer::HorizonCache::directory() const
+{
+	return m_directory;
+}
+
+bool TerrainViewer::HorizonCache::loadHorizonAngles(const Terrain& terrain,
+													quint64 terrainHash,
+													HorizonDirections directions,
+													HorizonPrecision precision,
+													int nearFieldRadius,
+													AnyHorizonAngles& horizonAngles) const
+{
+	AnyHorizonAngles angles = allocateHorizonAngles(directions, terrain.resolutionWidth(), terrain.resolutionHeight(), precision);
+
+	const bool loaded = std::visit([this, &terrain, terrainHash, nearFieldRadius](auto& a) {
+		const HorizonCacheHeader header = horizonCacheHeader(terrain, terrainHash, HorizonCacheEntry::horizonAngles,
+															 a.nbDirections, a.precision(), nearFieldRadius, -1, a.rawDataSize());
+		return readHorizonCacheEntry(m_directory, header, a.rawData());
+	}, angles);
+
+	if (loaded)
+	{
+		horizonAngles = std::move(angles);
+	}
+
+	return loaded;
+}
+
+bool TerrainViewer::HorizonCache::saveHorizonAngles(const Terrain& terrain,
+													quint64 terrainHash,
+													int nearFieldRadius,
+													const AnyHorizonAngles& horizonAngles) const
+{
+	return std::visit([this, &terrain, terrainHash, nearFieldRadius](const auto& a) {
+		const HorizonCacheHeader header = horizonCacheHeader(terrain, terrainHash, HorizonCacheEntry::horizonAngles,
+															 a.nbDirections, a.precision(), nearFieldRadius, -1, a.rawDataSize());
+		return writeHorizonCacheEntry(m_directory, header, a.rawData());
+	}, horizonAngles);
+}
+
+bool TerrainViewer::HorizonCache::loadLightMap(const Terrain& terrain, quint64 terrainHash, const Parameters& parameters, std::vector<float>& lightMap) const
+{
+	std::vector<float> data(static_cast<size_t>(terrain.resolutionWidth()) * terrain.resolutionHeight()
+							* lightMapChannels(parameters.shading));
+
+	const HorizonCacheHeader header = horizonCacheHeader(terrain, terrainHash, HorizonCacheEntry::lightMap,
+														 4 << static_cast<int>(parameters.horizonDirections),
+														 parameters.horizonPrecision,
+														 parameters.horizonNearFieldRadius,
+														 static_cast<int>(parameters.shading),
+														 data.size() * sizeof(float));
+
+	if (!readHorizonCacheEntry(m_directory, header, data.data()))
+	{
+		return false;
+	}
+
+	lightMap = std::move(data);
+
+	return true;
+}
+
+bool TerrainViewer::HorizonCache::saveLightMap(const Terrain& terrain, quint64 terrainHash, const Parameters& parameters, const std::vector<float>& lightMap) const
+{
+	const HorizonCacheHeader header = horizonCacheHeader(terrain, terrainHash, HorizonCacheEntry::lightMap,
+														 4 << static_cast<int>(parameters.horizonDirections),
+														 parameters.horizonPrecision,
+														 parameters.horizonNearFieldRadius,
+														 static_cast<int>(parameters.shading),
+														 lightMap.size() * sizeof(float));
+
+	return writeHorizonCacheEntry(m_directory, header, lightMap.data());
+}
+
+quint64 TerrainViewer::HorizonCache::terrainHash(const Terrain& terrain)
+{
+	// Rows are hashed one after the other, so that the hash does not depend on the layout of the altitudes
+	// and tiled terrains are not converted as a whole. 16 bits samples are hashed once converted to floats.
+	std::vector<float> row(terrain.resolutionWidth());
+	quint64 hash = 0;
+	for (int i = 0; i < terrain.resolutionHeight(); i++)
+	{
+		terrain.copyRow(i, 0, terrain.resolutionWidth(), row.data());
+		hash = xxh64(row.data(), row.size() * sizeof(float), hash);
+	}
+
+	const qint32 resolution[] = { static_cast<qint32>(terrain.sampleType()), terrain.resolutionWidth(), terrain.resolutionHeight() };
+	const float dimensions[] = { terrain.width(), terrain.height(), terrain.maxAltitude() };
+	hash = xxh64(resolution, sizeof(resolution), hash);
+
+	return xxh64(dimensions, sizeof(dimensions), hash);
+}
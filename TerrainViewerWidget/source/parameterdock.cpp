@@ -21,6 +21,14 @@ void ParameterDock::setParameters(const Parameters& parameters)
 {
 	ui->paletteComboBox->setCurrentIndex(static_cast<int>(parameters.palette));
 	ui->shadingComboBox->setCurrentIndex(static_cast<int>(parameters.shading));
+	ui->directionsComboBox->setCurrentIndex(static_cast<int>(parameters.horizonDirections));
+	ui->precisionComboBox->setCurrentIndex(static_cast<int>(parameters.horizonPrecision));
+	ui->nearFieldSpinBox->setValue(parameters.horizonNearFieldRadius);
+	ui->gpuCheckBox->setChecked(parameters.lightMapOnGpu);
+	ui->sunAzimuthDoubleSpinBox->setValue(parameters.sunAzimuth);
+	ui->sunElevationDoubleSpinBox->setValue(parameters.sunElevation);
+	ui->lightChannelComboBox->setCurrentIndex(static_cast<int>(parameters.lightChannel));
+	ui->localRadiusSpinBox->setValue(parameters.localLightRadius);
 	ui->wireframeCheckBox->setChecked(parameters.wireFrame);
 	ui->lodDoubleSpinBox->setValue(parameters.pixelsPerTriangleEdge);
 	ui->timeStepDoubleSpinBox->setValue(parameters.timeStep);
@@ -36,6 +44,14 @@ Parameters ParameterDock::parameters() const
 	return {
 		static_cast<Palette>(ui->paletteComboBox->currentIndex()),
 		static_cast<Shading>(ui->shadingComboBox->currentIndex()),
+		static_cast<HorizonDirections>(ui->directionsComboBox->currentIndex()),
+		static_cast<HorizonPrecision>(ui->precisionComboBox->currentIndex()),
+		ui->nearFieldSpinBox->value(),
+		ui->gpuCheckBox->isChecked(),
+		static_cast<float>(ui->sunAzimuthDoubleSpinBox->value()),
+		static_cast<float>(ui->sunElevationDoubleSpinBox->value()),
+		static_cast<LightChannel>(ui->lightChannelComboBox->currentIndex()),
+		ui->localRadiusSpinBox->value(),
 		ui->wireframeCheckBox->isChecked(),
 		static_cast<float>(ui->lodDoubleSpinBox->value()),
 		static_cast<float>(ui->timeStepDoubleSpinBox->value()),
@@ -51,6 +67,14 @@ void ParameterDock::createActions()
 {
 	connect(ui->paletteComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ParameterDock::parameterChanged);
 	connect(ui->shadingComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->directionsComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->precisionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->nearFieldSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->gpuCheckBox, &QCheckBox::stateChanged, this, &ParameterDock::parameterChanged);
+	connect(ui->sunAzimuthDoubleSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->sunElevationDoubleSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->lightChannelComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ParameterDock::parameterChanged);
+	connect(ui->localRadiusSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
 	connect(ui->wireframeCheckBox, &QCheckBox::stateChanged, this, &ParameterDock::parameterChanged);
 	connect(ui->lodDoubleSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
 	connect(ui->timeStepDoubleSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &ParameterDock::parameterChanged);
@@ -1,17 +1,232 @@
 ﻿#include "terrain.h"
 
 #include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
 
 #include "utils.h"
 
 using namespace TerrainViewer;
 
+const quint32 Terrain::binaryVersion = 1;
+
+/**
+ * \brief Header at the beginning of a binary terrain file
+ */
+struct TerrainFileHeader
+{
+	// Identifies binary terrain files: "TVTR"
+	char magic[4];
+	// Version of the file format
+	quint32 version;
+	// 0x01020304 in the byte order of the machine that wrote the file
+	quint32 byteOrder;
+	// Type of the altitudes, see TerrainSampleType
+	quint32 sampleType;
+	// Dimensions of the terrain
+	qint32 resolutionWidth;
+	qint32 resolutionHeight;
+	float width;
+	float height;
+	float maxAltitude;
+	// Zero, so that the following fields are aligned on 8 bytes with any ABI
+	quint32 reserved;
+	// Position of the altitudes in the file, a multiple of the page size, so that they are aligned once mapped
+	quint64 samplesOffset;
+	// Size in bytes of the altitudes
+	quint64 samplesSize;
+};
+
+static_assert(sizeof(TerrainFileHeader) == 56, "The header of binary terrain files must not depend on the padding of the compiler");
+
+// Altitudes start after the header, at the first page boundary
+const quint64 TerrainFilePageSize = 4096;
+
+// Byte order mark of the binary terrain files
+const quint32 TerrainFileByteOrder = 0x01020304;
+
+/**
+ * \brief Convert a row of pixels of a height map to altitudes
+ * \param pixels The pixels of the row
+ * \param count Number of pixels in the row
+ * \param scale Altitude of one unit of a pixel
+ * \param altitudes The altitudes of the row
+ */
+template <typename T>
+void convertHeightRow(const T* pixels, int count, float scale, float* altitudes)
+{
+#pragma omp simd
+	for (int j = 0; j < count; j++)
+	{
+		altitudes[j] = static_cast<float>(pixels[j]) * scale;
+	}
+}
+
+/**
+ * \brief Convert a row of color pixels of a height map to altitudes, from their gray level computed with qGray
+ * \param pixels The pixels of the row
+ * \param count Number of pixels in the row
+ * \param scale Altitude of one gray level
+ * \param altitudes The altitudes of the row
+ */
+void convertGrayRow(const QRgb* pixels, int count, float scale, float* altitudes)
+{
+#pragma omp simd
+	for (int j = 0; j < count; j++)
+	{
+		altitudes[j] = static_cast<float>(qGray(pixels[j])) * scale;
+	}
+}
+
+/**
+ * \brief Convert the rows of a cv::Mat height map to altitudes in parallel
+ * \param image The height map with one channel of type T, its rows may not be contiguous
+ * \param scale Altitude of one unit of a pixel
+ * \param altitudes The altitudes of the terrain
+ */
+template <typename T>
+void convertHeightImage(const cv::Mat& image, float scale, float* altitudes)
+{
+#pragma omp parallel for
+	for (int i = 0; i < image.rows; i++)
+	{
+		convertHeightRow(image.ptr<T>(i), image.cols, scale, altitudes + static_cast<size_t>(i) * image.cols);
+	}
+}
+
+/**
+ * \brief Convert altitudes to samples normalized on 16 bits, rounded to the closest sample
+ * \param altitudes The altitudes
+ * \param count Number of altitudes
+ * \param inverseScale Number of samples units in one unit of altitude
+ * \param samples The normalized samples
+ */
+void quantizeHeightRow(const float* altitudes, int count, float inverseScale, uint16_t* samples)
+{
+	const float maxSample = static_cast<float>(std::numeric_limits<uint16_t>::max());
+
+#pragma omp simd
+	for (int j = 0; j < count; j++)
+	{
+		const float sample = std::min(std::max(altitudes[j] * inverseScale, 0.0f), maxSample);
+		samples[j] = static_cast<uint16_t>(sample + 0.5f);
+	}
+}
+
+/**
+ * \brief Call a function on each part of a row of a terrain that is contiguous in memory:
+ *        the whole row in the row major layout, the row of each tile in the tiled layout
+ * \param terrain The terrain
+ * \param i Y coordinate of the row (height axis)
+ * \param j X coordinate of the first cell (width axis)
+ * \param count Number of cells in the row
+ * \param function Called with the index of the first sample of the part, see Terrain::sampleIndex,
+ *                 the number of cells in the part and the position of the part in the row
+ */
+template <typename Function>
+void forEachRowPart(const Terrain& terrain, int i, int j, int count, Function&& function)
+{
+	if (terrain.layout() == TerrainLayout::rowMajor)
+	{
+		function(terrain.sampleIndex(i, j), count, 0);
+		return;
+	}
+
+	for (int offset = 0; offset < count; )
+	{
+		const int length = std::min(count - offset, Terrain::tileSize - (j + offset) % Terrain::tileSize);
+		function(terrain.sampleIndex(i, j + offset), length, offset);
+
+		offset += length;
+	}
+}
+
+/**
+ * \brief Copy the samples of a terrain in the layout of another terrain with the same dimensions
+ * \param source The terrain from which samples are copied
+ * \param target The terrain whose layout is used
+ * \param samples The samples of the target terrain
+ */
+template <typename Sample>
+void copySamplesInLayout(const Terrain& source, const Terrain& target, Sample* samples)
+{
+	const Sample* input = source.samples<Sample>();
+
+#pragma omp parallel for
+	for (int i = 0; i < source.resolutionHeight(); i++)
+	{
+		forEachRowPart(target, i, 0, source.resolutionWidth(), [&](int index, int count, int offset)
+		{
+			forEachRowPart(source, i, offset, count, [&](int sourceIndex, int length, int sourceOffset)
+			{
+				std::copy_n(input + sourceIndex, length, samples + index + sourceOffset);
+			});
+		});
+	}
+}
+
+// Number of samples converted at once by convertSamples and quantizeSamples
+const int SampleBlockSize = 16384;
+
+/**
+ * \brief Convert samples normalized on 16 bits to altitudes in parallel
+ * \param samples The normalized samples
+ * \param count Number of samples
+ * \param scale Altitude of one unit of a sample
+ * \param altitudes The altitudes
+ */
+void convertSamples(const uint16_t* samples, size_t count, float scale, float* altitudes)
+{
+	const int blocks = static_cast<int>((count + SampleBlockSize - 1) / SampleBlockSize);
+
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++)
+	{
+		const size_t first = static_cast<size_t>(b) * SampleBlockSize;
+		const int length = static_cast<int>(std::min<size_t>(SampleBlockSize, count - first));
+
+		convertHeightRow(samples + first, length, scale, altitudes + first);
+	}
+}
+
+/**
+ * \brief Convert altitudes to samples normalized on 16 bits in parallel
+ * \param altitudes The altitudes
+ * \param count Number of altitudes
+ * \param inverseScale Number of samples units in one unit of altitude
+ * \param samples The normalized samples
+ */
+void quantizeSamples(const float* altitudes, size_t count, float inverseScale, uint16_t* samples)
+{
+	const int blocks = static_cast<int>((count + SampleBlockSize - 1) / SampleBlockSize);
+
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++)
+	{
+		const size_t first = static_cast<size_t>(b) * SampleBlockSize;
+		const int length = static_cast<int>(std::min<size_t>(SampleBlockSize, count - first));
+
+		quantizeHeightRow(altitudes + first, length, inverseScale, samples + first);
+	}
+}
+
 Terrain::Terrain(float width, float height, float maxAltitude) :
 	m_width(width),
 	m_height(height),
 	m_maxAltitude(maxAltitude),
 	m_resolutionWidth(0),
-	m_resolutionHeight(0)
+	m_resolutionHeight(0),
+	m_readOnly(false),
+	m_sampleType(TerrainSampleType::float32),
+	m_layout(TerrainLayout::rowMajor),
+	m_tileColumns(0)
 {
 }
 
@@ -21,11 +236,65 @@ Terrain::Terrain(float width, float height, float maxAltitude, int resolutionWid
 	m_maxAltitude(maxAltitude),
 	m_resolutionWidth(resolutionWidth),
 	m_resolutionHeight(resolutionHeight),
-	m_data(std::move(data))
+	m_readOnly(false),
+	m_sampleType(TerrainSampleType::float32),
+	m_layout(TerrainLayout::rowMajor),
+	m_tileColumns(0)
+{
+	assert(data.size() == m_resolutionHeight * m_resolutionWidth);
+
+	// The vector is moved in the storage of the altitudes, they are not copied
+	auto storage = std::make_shared<std::vector<float>>(std::move(data));
+	m_samples = std::shared_ptr<void>(storage, storage->data());
+}
+
+Terrain::Terrain(const Terrain& terrain) = default;
+
+Terrain::Terrain(Terrain&& terrain) noexcept :
+	m_width(terrain.m_width),
+	m_height(terrain.m_height),
+	m_maxAltitude(terrain.m_maxAltitude),
+	m_resolutionWidth(terrain.m_resolutionWidth),
+	m_resolutionHeight(terrain.m_resolutionHeight),
+	m_samples(std::move(terrain.m_samples)),
+	m_readOnly(terrain.m_readOnly),
+	m_sampleType(terrain.m_sampleType),
+	m_layout(terrain.m_layout),
+	m_tileColumns(terrain.m_tileColumns)
+{
+	// The moved terrain keeps its dimensions but no altitudes
+	terrain.m_resolutionWidth = 0;
+	terrain.m_resolutionHeight = 0;
+	terrain.m_readOnly = false;
+}
+
+Terrain& Terrain::operator=(const Terrain& terrain) = default;
+
+Terrain& Terrain::operator=(Terrain&& terrain) noexcept
 {
-	assert(m_data.size() == m_resolutionHeight * m_resolutionWidth);
+	if (this != &terrain)
+	{
+		m_width = terrain.m_width;
+		m_height = terrain.m_height;
+		m_maxAltitude = terrain.m_maxAltitude;
+		m_resolutionWidth = terrain.m_resolutionWidth;
+		m_resolutionHeight = terrain.m_resolutionHeight;
+		m_samples = std::move(terrain.m_samples);
+		m_readOnly = terrain.m_readOnly;
+		m_sampleType = terrain.m_sampleType;
+		m_layout = terrain.m_layout;
+		m_tileColumns = terrain.m_tileColumns;
+
+		terrain.m_resolutionWidth = 0;
+		terrain.m_resolutionHeight = 0;
+		terrain.m_readOnly = false;
+	}
+
+	return *this;
 }
 
+Terrain::~Terrain() = default;
+
 bool Terrain::loadFromImage(const QImage& image)
 {
 	if (image.isNull())
@@ -33,23 +302,41 @@ bool Terrain::loadFromImage(const QImage& image)
 		return false;
 	}
 
-	m_resolutionHeight = image.height();
-	m_resolutionWidth = image.width();
+	float* samples = allocate<float>(image.width(), image.height());
 
-	m_data.resize(m_resolutionHeight * m_resolutionWidth, 0.0f);
+	// Grayscale images are read as they are, other formats are converted once to read whole rows of QRgb
+	const QImage::Format format = image.format();
+	const QImage pixels = (format == QImage::Format_Grayscale8 || format == QImage::Format_Grayscale16)
+						? image
+						: image.convertToFormat(QImage::Format_ARGB32);
 
+#pragma omp parallel for
 	for (int i = 0; i < m_resolutionHeight; i++)
 	{
-		for (int j = 0; j < m_resolutionWidth; j++)
+		const uchar* row = pixels.constScanLine(i);
+		float* altitudes = samples + static_cast<size_t>(i) * m_resolutionWidth;
+
+		switch (format)
 		{
-			operator()(i, j) = (static_cast<float>(qGray(image.pixel(i, j))) / 255) * m_maxAltitude;
+		case QImage::Format_Grayscale8:
+			convertHeightRow(row, m_resolutionWidth, m_maxAltitude / std::numeric_limits<uint8_t>::max(), altitudes);
+			break;
+
+		case QImage::Format_Grayscale16:
+			convertHeightRow(reinterpret_cast<const uint16_t*>(row), m_resolutionWidth,
+							 m_maxAltitude / std::numeric_limits<uint16_t>::max(), altitudes);
+			break;
+
+		default:
+			convertGrayRow(reinterpret_cast<const QRgb*>(row), m_resolutionWidth, m_maxAltitude / 255, altitudes);
+			break;
 		}
 	}
 
 	return true;
 }
 
-bool Terrain::loadFromImage(const cv::Mat& image)
+bool Terrain::loadFromImage(const cv::Mat& image, TerrainSampleType type)
 {
 	// Check if the image is valid
 	if (image.data == nullptr)
@@ -58,7 +345,7 @@ bool Terrain::loadFromImage(const cv::Mat& image)
 	}
 	
 	// Check if the format is supported
-	if (image.type() != CV_8U && image.type() != CV_16U)
+	if (image.type() != CV_8U && image.type() != CV_16U && image.type() != CV_32F && image.type() != CV_64F)
 	{
 		return false;
 	}
@@ -69,35 +356,72 @@ bool Terrain::loadFromImage(const cv::Mat& image)
 		return false;
 	}
 
-	m_resolutionHeight = image.rows;
-	m_resolutionWidth = image.cols;
-
-	m_data.resize(m_resolutionHeight * m_resolutionWidth, 0.0f);
+	// Continuous altitudes of the sample type are shared with the image instead of being copied, until they are modified
+	const int sharedType = (type == TerrainSampleType::uint16) ? CV_16U : CV_32F;
+	if (image.type() == sharedType && image.isContinuous())
+	{
+		m_resolutionWidth = image.cols;
+		m_resolutionHeight = image.rows;
+
+		// An image on external memory is not reference counted, it could be released while the terrain uses it
+		auto storage = std::make_shared<cv::Mat>(image.u ? image : image.clone());
+		m_samples = std::shared_ptr<void>(storage, storage->ptr());
+		m_readOnly = true;
+		m_sampleType = type;
+		m_layout = TerrainLayout::rowMajor;
+		m_tileColumns = 0;
+
+		return true;
+	}
 
-	for (int i = 0; i < m_resolutionHeight; i++)
+	if (type == TerrainSampleType::uint16)
 	{
-		for (int j = 0; j < m_resolutionWidth; j++)
+		if (image.type() == CV_16U)
 		{
-			float normalizedValue = 0.0f;
+			uint16_t* samples = allocate<uint16_t>(image.cols, image.rows);
 
-			switch (image.type())
+#pragma omp parallel for
+			for (int i = 0; i < image.rows; i++)
 			{
-			case CV_8U:
-				normalizedValue = float(image.at<uint8_t>(i, j)) / std::numeric_limits<uint8_t>::max();
-				break;
-			case CV_16U:
-				normalizedValue = float(image.at<uint16_t>(i, j)) / std::numeric_limits<uint16_t>::max();
-				break;
+				std::copy_n(image.ptr<uint16_t>(i), image.cols, samples + static_cast<size_t>(i) * image.cols);
 			}
 
-			operator()(i, j) = normalizedValue * m_maxAltitude;
+			return true;
 		}
+
+		// Other images are loaded as floats and then normalized
+		if (!loadFromImage(image, TerrainSampleType::float32))
+		{
+			return false;
+		}
+
+		*this = withSampleType(TerrainSampleType::uint16);
+
+		return true;
+	}
+
+	float* samples = allocate<float>(image.cols, image.rows);
+
+	switch (image.type())
+	{
+	case CV_8U:
+		convertHeightImage<uint8_t>(image, m_maxAltitude / std::numeric_limits<uint8_t>::max(), samples);
+		break;
+	case CV_16U:
+		convertHeightImage<uint16_t>(image, m_maxAltitude / std::numeric_limits<uint16_t>::max(), samples);
+		break;
+	case CV_32F:
+		convertHeightImage<float>(image, 1.0f, samples);
+		break;
+	case CV_64F:
+		convertHeightImage<double>(image, 1.0f, samples);
+		break;
 	}
 
 	return true;
 }
 
-bool Terrain::saveInGrayscale8(const std::string& filename)
+bool Terrain::saveInGrayscale8(const std::string& filename) const
 {
 	cv::Mat image(m_resolutionHeight, m_resolutionWidth, CV_8U);
 
@@ -115,7 +439,7 @@ bool Terrain::saveInGrayscale8(const std::string& filename)
 	return cv::imwrite(filename, image);
 }
 
-bool Terrain::saveInGrayscale16(const std::string& filename)
+bool Terrain::saveInGrayscale16(const std::string& filename) const
 {
 	cv::Mat image(m_resolutionHeight, m_resolutionWidth, CV_16U);
 
@@ -133,6 +457,127 @@ bool Terrain::saveInGrayscale16(const std::string& filename)
 	return cv::imwrite(filename, image);
 }
 
+bool Terrain::saveInFloat32(const std::string& filename) const
+{
+	// The image only wraps the row major altitudes, they are written as they are
+	const Terrain rowMajor = withLayout(TerrainLayout::rowMajor).withSampleType(TerrainSampleType::float32);
+	const cv::Mat image(m_resolutionHeight, m_resolutionWidth, CV_32F, rowMajor.m_samples.get());
+
+	return cv::imwrite(filename, image);
+}
+
+bool Terrain::saveBinary(const std::string& filename, TerrainSampleType type) const
+{
+	const size_t count = static_cast<size_t>(m_resolutionWidth) * m_resolutionHeight;
+
+	TerrainFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+
+	std::memcpy(header.magic, "TVTR", sizeof(header.magic));
+	header.version = binaryVersion;
+	header.byteOrder = TerrainFileByteOrder;
+	header.sampleType = static_cast<quint32>(type);
+	header.resolutionWidth = m_resolutionWidth;
+	header.resolutionHeight = m_resolutionHeight;
+	header.width = m_width;
+	header.height = m_height;
+	header.maxAltitude = m_maxAltitude;
+	header.samplesOffset = TerrainFilePageSize;
+	header.samplesSize = count * ((type == TerrainSampleType::uint16) ? sizeof(uint16_t) : sizeof(float));
+
+	QSaveFile file(QString::fromStdString(filename));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	// The header is padded with zeros up to the first page boundary
+	QByteArray page(TerrainFilePageSize, '\0');
+	std::memcpy(page.data(), &header, sizeof(header));
+	file.write(page);
+
+	// Samples are converted only if their layout or their type differs from the file
+	const Terrain samples = withLayout(TerrainLayout::rowMajor).withSampleType(type);
+	file.write(static_cast<const char*>(samples.m_samples.get()), header.samplesSize);
+
+	return file.commit();
+}
+
+bool Terrain::loadBinary(const std::string& filename)
+{
+	auto file = std::make_unique<QFile>(QString::fromStdString(filename));
+	if (!file->open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+
+	TerrainFileHeader header;
+	if (file->read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+	 || std::memcmp(header.magic, "TVTR", sizeof(header.magic)) != 0)
+	{
+		return false;
+	}
+
+	if (header.version != binaryVersion)
+	{
+		qWarning() << "Unsupported version" << header.version << "of the binary terrain" << file->fileName();
+		return false;
+	}
+
+	if (header.byteOrder != TerrainFileByteOrder)
+	{
+		qWarning() << "The binary terrain" << file->fileName() << "was written with another byte order";
+		return false;
+	}
+
+	if (header.sampleType != static_cast<quint32>(TerrainSampleType::float32)
+	 && header.sampleType != static_cast<quint32>(TerrainSampleType::uint16))
+	{
+		qWarning() << "Unsupported sample type" << header.sampleType << "of the binary terrain" << file->fileName();
+		return false;
+	}
+
+	const size_t count = static_cast<size_t>(header.resolutionWidth) * header.resolutionHeight;
+	const bool uint16Samples = (header.sampleType == static_cast<quint32>(TerrainSampleType::uint16));
+	const size_t sampleSize = uint16Samples ? sizeof(uint16_t) : sizeof(float);
+	const quint64 fileSize = static_cast<quint64>(file->size());
+	// The samples are read in place: they must be after the header and aligned on their size.
+	// The end of the samples is not computed, the sum of the offset and the size could wrap around.
+	if (header.resolutionWidth < 2 || header.resolutionHeight < 2
+	 || header.samplesSize != count * sampleSize
+	 || header.samplesOffset < sizeof(TerrainFileHeader)
+	 || header.samplesOffset % sampleSize != 0
+	 || header.samplesSize > fileSize
+	 || header.samplesOffset > fileSize - header.samplesSize)
+	{
+		qWarning() << "The binary terrain" << file->fileName() << "is corrupted";
+		return false;
+	}
+
+	// Private mapping: pages are read when they are first accessed, and modified pages are copied in memory
+	uchar* memory = file->map(header.samplesOffset, header.samplesSize, QFileDevice::MapPrivateOption);
+	if (memory == nullptr)
+	{
+		return false;
+	}
+
+	m_width = header.width;
+	m_height = header.height;
+	m_maxAltitude = header.maxAltitude;
+	m_resolutionWidth = header.resolutionWidth;
+	m_resolutionHeight = header.resolutionHeight;
+	// The file is unmapped and closed when the last terrain sharing it is destroyed.
+	// Normalized altitudes stay on 16 bits, they are converted when they are read.
+	std::shared_ptr<QFile> storage(std::move(file));
+	m_samples = std::shared_ptr<void>(storage, memory);
+	m_readOnly = false;
+	m_sampleType = uint16Samples ? TerrainSampleType::uint16 : TerrainSampleType::float32;
+	m_layout = TerrainLayout::rowMajor;
+	m_tileColumns = 0;
+
+	return true;
+}
+
 bool Terrain::empty() const
 {
 	return (m_width == 0 || m_height == 0);
@@ -165,7 +610,153 @@ float Terrain::maxAltitude() const
 
 const float* Terrain::data() const
 {
-	return m_data.data();
+	assert(m_sampleType == TerrainSampleType::float32);
+
+	return samples<float>();
+}
+
+float* Terrain::data()
+{
+	detach();
+
+	return static_cast<float*>(m_samples.get());
+}
+
+TerrainSampleType Terrain::sampleType() const
+{
+	return m_sampleType;
+}
+
+float Terrain::sampleScale() const
+{
+	if (m_sampleType == TerrainSampleType::uint16)
+	{
+		return m_maxAltitude / std::numeric_limits<uint16_t>::max();
+	}
+
+	return 1.0f;
+}
+
+Terrain Terrain::withSampleType(TerrainSampleType type) const
+{
+	if (type == m_sampleType || !m_samples)
+	{
+		return *this;
+	}
+
+	Terrain terrain(m_width, m_height, m_maxAltitude);
+	terrain.m_resolutionWidth = m_resolutionWidth;
+	terrain.m_resolutionHeight = m_resolutionHeight;
+	terrain.m_sampleType = type;
+	terrain.m_layout = m_layout;
+	terrain.m_tileColumns = m_tileColumns;
+
+	// Padding of the tiles is converted with the altitudes
+	const size_t count = sampleCount();
+	if (type == TerrainSampleType::uint16)
+	{
+		auto* samples = new uint16_t[count];
+		terrain.m_samples.reset(samples, std::default_delete<uint16_t[]>());
+
+		const float inverseScale = (m_maxAltitude > 0.0f) ? std::numeric_limits<uint16_t>::max() / m_maxAltitude : 0.0f;
+		quantizeSamples(this->samples<float>(), count, inverseScale, samples);
+	}
+	else
+	{
+		auto* samples = new float[count];
+		terrain.m_samples.reset(samples, std::default_delete<float[]>());
+
+		convertSamples(this->samples<uint16_t>(), count, sampleScale(), samples);
+	}
+
+	return terrain;
+}
+
+TerrainLayout Terrain::layout() const
+{
+	return m_layout;
+}
+
+Terrain Terrain::withLayout(TerrainLayout layout) const
+{
+	if (layout == m_layout || !m_samples)
+	{
+		return *this;
+	}
+
+	Terrain terrain(m_width, m_height, m_maxAltitude);
+	terrain.m_resolutionWidth = m_resolutionWidth;
+	terrain.m_resolutionHeight = m_resolutionHeight;
+	terrain.m_sampleType = m_sampleType;
+	terrain.m_layout = layout;
+	terrain.m_tileColumns = (layout == TerrainLayout::tiled) ? (m_resolutionWidth + tileSize - 1) / tileSize : 0;
+
+	const size_t count = terrain.sampleCount();
+	if (m_sampleType == TerrainSampleType::uint16)
+	{
+		terrain.m_samples.reset(new uint16_t[count], std::default_delete<uint16_t[]>());
+	}
+	else
+	{
+		terrain.m_samples.reset(new float[count], std::default_delete<float[]>());
+	}
+
+	// Cells of the tiles on the borders that are outside of the terrain are never read, they are only cleared
+	if (count > static_cast<size_t>(m_resolutionWidth) * m_resolutionHeight)
+	{
+		std::memset(terrain.m_samples.get(), 0, count * sampleSize());
+	}
+
+	// Each part of a row that is contiguous in both layouts is copied at once
+	if (m_sampleType == TerrainSampleType::uint16)
+	{
+		copySamplesInLayout(*this, terrain, static_cast<uint16_t*>(terrain.m_samples.get()));
+	}
+	else
+	{
+		copySamplesInLayout(*this, terrain, static_cast<float*>(terrain.m_samples.get()));
+	}
+
+	return terrain;
+}
+
+void Terrain::copyRow(int i, int j, int count, float* output) const
+{
+	assert(i >= 0 && i < m_resolutionHeight);
+	assert(j >= 0 && j + count <= m_resolutionWidth);
+
+	if (m_sampleType == TerrainSampleType::uint16)
+	{
+		const uint16_t* input = samples<uint16_t>();
+		const float scale = sampleScale();
+
+		forEachRowPart(*this, i, j, count, [&](int index, int length, int offset)
+		{
+			convertHeightRow(input + index, length, scale, output + offset);
+		});
+	}
+	else
+	{
+		const float* input = samples<float>();
+
+		forEachRowPart(*this, i, j, count, [&](int index, int length, int offset)
+		{
+			std::copy_n(input + index, length, output + offset);
+		});
+	}
+}
+
+void Terrain::setRow(int i, int j, int count, const float* input)
+{
+	assert(i >= 0 && i < m_resolutionHeight);
+	assert(j >= 0 && j + count <= m_resolutionWidth);
+
+	float* output = data();
+
+	forEachRowPart(*this, i, j, count, [&](int index, int length, int offset)
+	{
+		std::copy_n(input + offset, length, output + index);
+	});
 }
 
 int Terrain::resolutionWidth() const
@@ -186,12 +777,12 @@ int Terrain::cellIndex(int i, int j) const
 	return i * m_resolutionWidth + j;
 }
 
-const float& Terrain::operator()(int i, int j) const
+float Terrain::operator()(int i, int j) const
 {
 	assert(i >= 0 && i < m_resolutionHeight);
 	assert(j >= 0 && j < m_resolutionWidth);
 
-	return m_data[i * m_resolutionWidth + j];
+	return sampleAltitude(sampleIndex(i, j));
 }
 
 float& Terrain::operator()(int i, int j)
@@ -199,15 +790,17 @@ float& Terrain::operator()(int i, int j)
 	assert(i >= 0 && i < m_resolutionHeight);
 	assert(j >= 0 && j < m_resolutionWidth);
 
-	return m_data[i * m_resolutionWidth + j];
+	detach();
+
+	return static_cast<float*>(m_samples.get())[sampleIndex(i, j)];
 }
 
-const float& Terrain::atClamp(int i, int j) const
+float Terrain::atClamp(int i, int j) const
 {
 	const int k = clamp(i, 0, m_resolutionHeight - 1);
 	const int l = clamp(j, 0, m_resolutionWidth - 1);
 
-	return m_data[k * m_resolutionWidth + l];
+	return sampleAltitude(sampleIndex(k, l));
 }
 
 float& Terrain::atClamp(int i, int j)
@@ -215,7 +808,82 @@ float& Terrain::atClamp(int i, int j)
 	const int k = clamp(i, 0, m_resolutionHeight - 1);
 	const int l = clamp(j, 0, m_resolutionWidth - 1);
 
-	return m_data[k * m_resolutionWidth + l];
+	detach();
+
+	return static_cast<float*>(m_samples.get())[sampleIndex(k, l)];
+}
+
+template <typename Sample>
+Sample* Terrain::allocate(int resolutionWidth, int resolutionHeight)
+{
+	static_assert(std::is_same<Sample, float>::value || std::is_same<Sample, uint16_t>::value,
+				  "Altitudes are stored as float or uint16_t");
+
+	m_resolutionWidth = resolutionWidth;
+	m_resolutionHeight = resolutionHeight;
+
+	// The previous altitudes are released first to lower the peak of memory.
+	// Loaders write every altitude, they are not initialized.
+	m_samples.reset();
+	auto* samples = new Sample[static_cast<size_t>(m_resolutionHeight) * m_resolutionWidth];
+	m_samples.reset(samples, std::default_delete<Sample[]>());
+	m_readOnly = false;
+	m_sampleType = std::is_same<Sample, uint16_t>::value ? TerrainSampleType::uint16 : TerrainSampleType::float32;
+	m_layout = TerrainLayout::rowMajor;
+	m_tileColumns = 0;
+
+	return samples;
+}
+
+size_t Terrain::sampleCount() const
+{
+	if (m_layout == TerrainLayout::tiled)
+	{
+		const size_t tileRows = (m_resolutionHeight + tileSize - 1) / tileSize;
+
+		return tileRows * m_tileColumns * tileSize * tileSize;
+	}
+
+	return static_cast<size_t>(m_resolutionHeight) * m_resolutionWidth;
+}
+
+size_t Terrain::sampleSize() const
+{
+	return (m_sampleType == TerrainSampleType::uint16) ? sizeof(uint16_t) : sizeof(float);
+}
+
+float Terrain::sampleAltitude(int index) const
+{
+	if (m_sampleType == TerrainSampleType::uint16)
+	{
+		return static_cast<float>(samples<uint16_t>()[index]) * sampleScale();
+	}
+
+	return samples<float>()[index];
+}
+
+void Terrain::detach()
+{
+	if (!m_samples)
+	{
+		return;
+	}
+
+	// Normalized altitudes cannot be modified through a float reference, the conversion is a new copy
+	if (m_sampleType != TerrainSampleType::float32)
+	{
+		*this = withSampleType(TerrainSampleType::float32);
+	}
+	else if (m_readOnly || m_samples.use_count() > 1)
+	{
+		const size_t count = sampleCount();
+
+		auto* samples = new float[count];
+		std::copy_n(this->samples<float>(), count, samples);
+
+		m_samples.reset(samples, std::default_delete<float[]>());
+		m_readOnly = false;
+	}
 }
 
 QVector3D Terrain::vertex(int i, int j) const
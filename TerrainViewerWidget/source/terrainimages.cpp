@@ -1,37 +1,51 @@
 #include "terrainimages.h"
 
 #include "occlusion.h"
+#include "terrainproducts.h"
 #include "utils.h"
 
 using namespace TerrainViewer;
 
-std::vector<QVector4D> TerrainViewer::computeNormals(const Terrain& terrain)
+/**
+ * \brief Return an image of a normal map
+ * \param terrain The terrain of the normal map
+ * \param normalMap The normals of the terrain
+ * \return A 8 bits RGB image of the normal map
+ */
+QImage normalImage(const Terrain& terrain, const std::vector<QVector4D>& normalMap)
 {
-	std::vector<QVector4D> normals(terrain.resolutionWidth() * terrain.resolutionHeight());
+	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_RGB32);
 
 #pragma omp parallel for
 	for (int i = 0; i < terrain.resolutionHeight(); i++)
 	{
 		for (int j = 0; j < terrain.resolutionWidth(); j++)
 		{
-			const int index = i * terrain.resolutionWidth() + j;
+			const auto index = i * terrain.resolutionWidth() + j;
 
-			const QVector3D normal = terrain.normal(i, j).normalized();
-			normals[index].setX(normal.x());
-			normals[index].setY(normal.y());
-			normals[index].setZ(normal.z());
-			normals[index].setW(0.0);
+			const auto red = static_cast<uint8_t>(255.0f * (normalMap[index].x() + 1.0f) / 2.0f);
+			const auto green = static_cast<uint8_t>(255.0f * (normalMap[index].y() + 1.0f) / 2.0f);
+			const auto blue = static_cast<uint8_t>(255.0f * (normalMap[index].z() + 1.0f) / 2.0f);
+			image.setPixel(j, i, qRgb(red, green, blue));
 		}
 	}
 
-	return normals;
+	return image;
 }
 
-QImage TerrainViewer::normalTextureImage(const Terrain& terrain)
+/**
+ * \brief Return an image of a light map
+ * \param terrain The terrain of the light map
+ * \param lightMap The coefficients of the light map
+ * \param parameters The parameters of the light map, with the displayed channel
+ * \return A 8 bits grayscale image of the light map
+ */
+QImage lightMapImage(const Terrain& terrain, const std::vector<float>& lightMap, const Parameters& parameters)
 {
-	const auto normalMap = computeNormals(terrain);
+	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_Grayscale8);
 
-	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_RGB32);
+	const int channels = lightMapChannels(parameters.shading);
+	const int channel = displayedLightMapChannel(parameters);
 
 #pragma omp parallel for
 	for (int i = 0; i < terrain.resolutionHeight(); i++)
@@ -40,22 +54,27 @@ QImage TerrainViewer::normalTextureImage(const Terrain& terrain)
 		{
 			const auto index = i * terrain.resolutionWidth() + j;
 
-			const auto red = static_cast<uint8_t>(255.0f * (normalMap[index].x() + 1.0f) / 2.0f);
-			const auto green = static_cast<uint8_t>(255.0f * (normalMap[index].y() + 1.0f) / 2.0f);
-			const auto blue = static_cast<uint8_t>(255.0f * (normalMap[index].z() + 1.0f) / 2.0f);
-			image.setPixel(j, i, qRgb(red, green, blue));
+			const auto gray = static_cast<uint8_t>(255.0f * (lightMap[index * channels + channel] / 1.0f));
+			image.setPixel(j, i, qRgb(gray, gray, gray));
 		}
 	}
 
 	return image;
 }
 
-QImage TerrainViewer::lightMapTextureImage(const Terrain& terrain, const Parameters& parameters)
+/**
+ * \brief Return an image of the terrain colored with the DEM palette and lit by a light map
+ * \param terrain A terrain
+ * \param lightMap The coefficients of the light map of the terrain
+ * \param parameters The parameters of the light map, with the displayed channel
+ * \return A 8 bits color image of the terrain
+ */
+QImage demImage(const Terrain& terrain, const std::vector<float>& lightMap, const Parameters& parameters)
 {
-	const auto horizonAngles = computeHorizonAngles(terrain);
-	const auto lightMap = computeLightMap(terrain, horizonAngles, parameters);
+	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_RGB32);
 
-	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_Grayscale8);
+	const int channels = lightMapChannels(parameters.shading);
+	const int channel = displayedLightMapChannel(parameters);
 
 #pragma omp parallel for
 	for (int i = 0; i < terrain.resolutionHeight(); i++)
@@ -64,34 +83,66 @@ QImage TerrainViewer::lightMapTextureImage(const Terrain& terrain, const Paramet
 		{
 			const auto index = i * terrain.resolutionWidth() + j;
 
-			const auto gray = static_cast<uint8_t>(255.0f * (lightMap[index] / 1.0f));
-			image.setPixel(j, i, qRgb(gray, gray, gray));
+			const float normalizedAltitude = terrain(i, j) / terrain.maxAltitude();
+			const auto color = colorDemScreen(normalizedAltitude);
+			const auto light = lightMap[index * channels + channel];
+			image.setPixel(j, i, toQRgb(color * light));
 		}
 	}
 
 	return image;
 }
 
-QImage TerrainViewer::demTextureImage(const Terrain& terrain, const Parameters& parameters)
+std::vector<QVector4D> TerrainViewer::computeNormals(const Terrain& terrain)
 {
-	const auto horizonAngles = computeHorizonAngles(terrain);
-	const auto lightMap = computeLightMap(terrain, horizonAngles, parameters);
-
-	QImage image(terrain.resolutionWidth(), terrain.resolutionHeight(), QImage::Format_RGB32);
+	std::vector<QVector4D> normals(terrain.resolutionWidth() * terrain.resolutionHeight());
 
 #pragma omp parallel for
 	for (int i = 0; i < terrain.resolutionHeight(); i++)
 	{
 		for (int j = 0; j < terrain.resolutionWidth(); j++)
 		{
-			const auto index = i * terrain.resolutionWidth() + j;
+			const int index = i * terrain.resolutionWidth() + j;
 
-			const float normalizedAltitude = terrain(i, j) / terrain.maxAltitude();
-			const auto color = colorDemScreen(normalizedAltitude);
-			const auto light = lightMap[index];
-			image.setPixel(j, i, toQRgb(color * light));
+			const QVector3D normal = terrain.normal(i, j).normalized();
+			normals[index].setX(normal.x());
+			normals[index].setY(normal.y());
+			normals[index].setZ(normal.z());
+			normals[index].setW(0.0);
 		}
 	}
 
-	return image;
+	return normals;
+}
+
+QImage TerrainViewer::normalTextureImage(const Terrain& terrain)
+{
+	return normalImage(terrain, computeNormals(terrain));
+}
+
+QImage TerrainViewer::normalTextureImage(TerrainProducts& products)
+{
+	return normalImage(products.terrain(), products.normals());
+}
+
+QImage TerrainViewer::lightMapTextureImage(const Terrain& terrain, const Parameters& parameters)
+{
+	// The horizon angles are not needed afterwards, hence they are not stored
+	return lightMapImage(terrain, computeLightMap(terrain, parameters), parameters);
+}
+
+QImage TerrainViewer::lightMapTextureImage(TerrainProducts& products, const Parameters& parameters)
+{
+	return lightMapImage(products.terrain(), products.lightMap(parameters), parameters);
+}
+
+QImage TerrainViewer::demTextureImage(const Terrain& terrain, const Parameters& parameters)
+{
+	// The horizon angles are not needed afterwards, hence they are not stored
+	return demImage(terrain, computeLightMap(terrain, parameters), parameters);
+}
+
+QImage TerrainViewer::demTextureImage(TerrainProducts& products, const Parameters& parameters)
+{
+	return demImage(products.terrain(), products.lightMap(parameters), parameters);
 }
@@ -0,0 +1,445 @@
+#include "terrainproducts.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include <QDebug>
+
+#include "terrainimages.h"
+
+using namespace TerrainViewer;
+
+/**
+ * \brief Load the horizon angles from the disk cache, or compute and cache them
+ * \param terrain A terrain
+ * \param terrainHash The hash of the terrain in the disk cache, see HorizonCache::terrainHash
+ * \param directions The preset for the number of azimuthal directions
+ * \param precision Storage precision of the horizon angles
+ * \param nearFieldRadius Radius of the near field, 0 for exact horizon angles, see computeHorizonAngles
+ * \param cache The disk cache
+ * \return The horizon angles of the terrain
+ */
+std::shared_ptr<const AnyHorizonAngles> loadOrComputeHorizonAngles(const Terrain& terrain,
+																   quint64 terrainHash,
+																   HorizonDirections directions,
+																   HorizonPrecision precision,
+																   int nearFieldRadius,
+																   const HorizonCache& cache)
+{
+	auto horizonAngles = std::make_shared<AnyHorizonAngles>();
+
+	if (!cache.loadHorizonAngles(terrain, terrainHash, directions, precision, nearFieldRadius, *horizonAngles))
+	{
+		*horizonAngles = computeHorizonAngles(terrain, directions, precision, nearFieldRadius);
+
+		if (!cache.saveHorizonAngles(terrain, terrainHash, nearFieldRadius, *horizonAngles))
+		{
+			qWarning() << "Could not cache the horizon angles in" << cache.directory();
+		}
+	}
+
+	return horizonAngles;
+}
+
+/**
+ * \brief Bake the previews of a light map on decimated terrains, from the coarsest to the finest
+ * \param terrain A terrain
+ * \param parameters Parameters of the light map
+ * \param cancelled Checked between each preview, no more previews are baked once it is set
+ * \param preview Called with each preview
+ */
+void bakeLightMapPreviews(const Terrain& terrain,
+						  const Parameters& parameters,
+						  const std::atomic<bool>& cancelled,
+						  const LightMapPreviewCallback& preview)
+{
+	if (!preview)
+	{
+		return;
+	}
+
+	const std::vector<int> factors = lightMapPreviewFactors(terrain);
+	const int passes = static_cast<int>(factors.size()) + 1;
+
+	for (int pass = 0; pass < static_cast<int>(factors.size()) && !cancelled; pass++)
+	{
+		const int factor = factors[pass];
+		const Terrain decimated = decimateTerrain(terrain, factor);
+
+		// Radii are in cells, they are scaled to cover the same distance on the decimated terrain
+		Parameters decimatedParameters = parameters;
+		if (parameters.horizonNearFieldRadius > 0)
+		{
+			decimatedParameters.horizonNearFieldRadius = std::max(1, parameters.horizonNearFieldRadius / factor);
+		}
+		decimatedParameters.localLightRadius = std::max(1, parameters.localLightRadius / factor);
+
+		LightMapPreview result{ pass, passes, decimated.resolutionWidth(), decimated.resolutionHeight(), {} };
+		if (shadingUsesHorizonAngles(parameters.shading))
+		{
+			auto horizonAngles = std::make_shared<AnyHorizonAngles>(computeHorizonAngles(decimated,
+																						 decimatedParameters.horizonDirections,
+																						 decimatedParameters.horizonPrecision,
+																						 decimatedParameters.horizonNearFieldRadius));
+			result.bake.lightMap = computeLightMap(decimated, *horizonAngles, decimatedParameters);
+			result.bake.horizonAngles = std::move(horizonAngles);
+		}
+		else
+		{
+			result.bake.lightMap = computeLightMap(decimated, decimatedParameters);
+		}
+
+		if (!cancelled)
+		{
+			preview(std::move(result));
+		}
+	}
+}
+
+std::vector<int> TerrainViewer::lightMapPreviewFactors(const Terrain& terrain)
+{
+	// Largest resolution of the coarsest preview, and ratio between the resolutions of two previews
+	const int previewResolution = 512;
+	const int previewRatio = 4;
+
+	const int resolution = std::max(terrain.resolutionWidth(), terrain.resolutionHeight());
+
+	int factor = 1;
+	while (resolution > previewResolution * factor)
+	{
+		factor *= previewRatio;
+	}
+
+	std::vector<int> factors;
+	for (; factor > 1; factor /= previewRatio)
+	{
+		factors.push_back(factor);
+	}
+
+	return factors;
+}
+
+Terrain TerrainViewer::decimateTerrain(const Terrain& terrain, int factor)
+{
+	assert(factor > 0);
+
+	const int width = terrain.resolutionWidth();
+	const int height = terrain.resolutionHeight();
+	const int decimatedWidth = (width + factor - 1) / factor;
+	const int decimatedHeight = (height + factor - 1) / factor;
+
+	std::vector<float> data(static_cast<size_t>(decimatedWidth) * decimatedHeight);
+
+#pragma omp parallel for
+	for (int i = 0; i < decimatedHeight; i++)
+	{
+		const int lastRow = std::min(height, (i + 1) * factor);
+
+		for (int j = 0; j < decimatedWidth; j++)
+		{
+			const int lastColumn = std::min(width, (j + 1) * factor);
+
+			float sum = 0.0f;
+			for (int k = i * factor; k < lastRow; k++)
+			{
+				for (int l = j * factor; l < lastColumn; l++)
+				{
+					sum += terrain(k, l);
+				}
+			}
+
+			data[static_cast<size_t>(i) * decimatedWidth + j] = sum / float((lastRow - i * factor) * (lastColumn - j * factor));
+		}
+	}
+
+	return Terrain(terrain.width(), terrain.height(), terrain.maxAltitude(), decimatedWidth, decimatedHeight, std::move(data));
+}
+
+LightMapBake TerrainViewer::bakeLightMap(const Terrain& terrain,
+										 const Parameters& parameters,
+										 std::shared_ptr<const AnyHorizonAngles> horizonAngles,
+										 const HorizonCache& cache,
+										 const std::atomic<bool>& cancelled,
+										 const LightMapPreviewCallback& preview)
+{
+	LightMapBake bake;
+	bake.horizonAngles = std::move(horizonAngles);
+
+	// Other light maps are 1.0f everywhere, or computed without the horizon angles for the local light
+	if (!shadingUsesHorizonAngles(parameters.shading))
+	{
+		if (parameters.shading == Shading::localLight)
+		{
+			bakeLightMapPreviews(terrain, parameters, cancelled, preview);
+		}
+
+		bake.lightMap = computeLightMap(terrain, parameters);
+		return bake;
+	}
+
+	if (cancelled)
+	{
+		return bake;
+	}
+
+	// The hash reads the whole terrain, it is computed once for all the accesses to the disk cache
+	const quint64 terrainHash = HorizonCache::terrainHash(terrain);
+
+	// With the sun, the horizon angles are displayed too, hence they are needed even if the light map is cached
+	const bool lightMapCached = cache.loadLightMap(terrain, terrainHash, parameters, bake.lightMap);
+	if (lightMapCached && parameters.shading != Shading::sunLight)
+	{
+		return bake;
+	}
+
+	// Either the light map or the horizon angles to display with the sun must be computed
+	if (!(lightMapCached && bake.horizonAngles))
+	{
+		bakeLightMapPreviews(terrain, parameters, cancelled, preview);
+	}
+
+	if (cancelled)
+	{
+		return bake;
+	}
+
+	if (!bake.horizonAngles)
+	{
+		bake.horizonAngles = loadOrComputeHorizonAngles(terrain,
+																terrainHash,
+																parameters.horizonDirections,
+																parameters.horizonPrecision,
+																parameters.horizonNearFieldRadius,
+																cache);
+	}
+
+	if (lightMapCached || cancelled)
+	{
+		return bake;
+	}
+
+	bake.lightMap = computeLightMap(terrain, *bake.horizonAngles, parameters);
+
+	if (!cache.saveLightMap(terrain, terrainHash, parameters, bake.lightMap))
+	{
+		qWarning() << "Could not cache the light map in" << cache.directory();
+	}
+
+	return bake;
+}
+
+TerrainViewer::TerrainProducts::TerrainProducts(const Terrain& terrain) :
+	m_terrain(terrain),
+	m_hasNormals(false),
+	m_horizonAngles(nullptr),
+	m_directions(HorizonDirections::sixteen),
+	m_precision(HorizonPrecision::float32),
+	m_nearFieldRadius(0)
+{
+}
+
+const Terrain& TerrainViewer::TerrainProducts::terrain() const
+{
+	return m_terrain;
+}
+
+const HorizonCache& TerrainViewer::TerrainProducts::cache() const
+{
+	return m_cache;
+}
+
+void TerrainViewer::TerrainProducts::clear()
+{
+	m_hasNormals = false;
+	m_normals.clear();
+	m_normals.shrink_to_fit();
+
+	m_horizonAngles.reset();
+
+	m_lightMaps.clear();
+}
+
+const std::vector<QVector4D>& TerrainViewer::TerrainProducts::normals()
+{
+	if (!m_hasNormals)
+	{
+		m_normals = computeNormals(m_terrain);
+		m_hasNormals = true;
+	}
+
+	return m_normals;
+}
+
+const AnyHorizonAngles& TerrainViewer::TerrainProducts::horizonAngles(HorizonDirections directions,
+																	  HorizonPrecision precision,
+																	  int nearFieldRadius)
+{
+	if (!findHorizonAngles(directions, precision, nearFieldRadius))
+	{
+		// Release the previous horizon angles before allocating the new ones
+		m_horizonAngles.reset();
+
+		m_horizonAngles = loadOrComputeHorizonAngles(m_terrain, HorizonCache::terrainHash(m_terrain), directions, precision, nearFieldRadius, m_cache);
+		m_directions = directions;
+		m_precision = precision;
+		m_nearFieldRadius = nearFieldRadius;
+	}
+
+	return *m_horizonAngles;
+}
+
+const std::vector<float>& TerrainViewer::TerrainProducts::lightMap(const Parameters& parameters)
+{
+	const std::vector<float>* lightMap = findLightMap(parameters);
+	if (lightMap != nullptr)
+	{
+		return *lightMap;
+	}
+
+	const std::atomic<bool> cancelled(false);
+	LightMapBake bake = bakeLightMap(m_terrain,
+									 parameters,
+									 findHorizonAngles(parameters.horizonDirections,
+													   parameters.horizonPrecision,
+													   parameters.horizonNearFieldRadius),
+									 m_cache,
+									 cancelled);
+
+	return insert(parameters, std::move(bake));
+}
+
+std::shared_ptr<const AnyHorizonAngles> TerrainViewer::TerrainProducts::findHorizonAngles(HorizonDirections directions,
+																						  HorizonPrecision precision,
+																						  int nearFieldRadius) const
+{
+	if (m_horizonAngles && m_directions == directions && m_precision == precision && m_nearFieldRadius == nearFieldRadius)
+	{
+		return m_horizonAngles;
+	}
+
+	return nullptr;
+}
+
+const std::vector<float>* TerrainViewer::TerrainProducts::findLightMap(const Parameters& parameters) const
+{
+	const auto it = m_lightMaps.find(lightMapKey(parameters));
+	if (it != m_lightMaps.end())
+	{
+		return &it->second;
+	}
+
+	return nullptr;
+}
+
+const std::vector<float>& TerrainViewer::TerrainProducts::insert(const Parameters& parameters, LightMapBake bake)
+{
+	if (bake.horizonAngles)
+	{
+		m_horizonAngles = std::move(bake.horizonAngles);
+		m_directions = parameters.horizonDirections;
+		m_precision = parameters.horizonPrecision;
+		m_nearFieldRadius = parameters.horizonNearFieldRadius;
+	}
+
+	return m_lightMaps[lightMapKey(parameters)] = std::move(bake.lightMap);
+}
+
+bool TerrainViewer::TerrainProducts::update(const QRect& region, const Parameters& parameters, QRect& lightMapRegion)
+{
+	lightMapRegion = QRect();
+
+	// Normals are computed again when requested
+	m_hasNormals = false;
+	m_normals.clear();
+	m_normals.shrink_to_fit();
+
+	// Only the light map of the parameters is updated, the others are obsolete
+	const LightMapKey key = lightMapKey(parameters);
+	std::vector<float> lightMap;
+
+	const auto it = m_lightMaps.find(key);
+	if (it != m_lightMaps.end())
+	{
+		lightMap = std::move(it->second);
+	}
+	m_lightMaps.clear();
+
+	// Other light maps are 1.0f everywhere, whatever the altitudes, or updated around the region
+	// for the local light, and the horizon angles are obsolete
+	if (!shadingUsesHorizonAngles(parameters.shading))
+	{
+		m_horizonAngles.reset();
+
+		if (lightMap.empty())
+		{
+			return false;
+		}
+
+		if (parameters.shading == Shading::localLight)
+		{
+			lightMapRegion = updateLocalLightMap(m_terrain, parameters, region, lightMap);
+		}
+
+		m_lightMaps[key] = std::move(lightMap);
+		return true;
+	}
+
+	// Horizon angles with other parameters are obsolete, and without the horizon angles
+	// of the parameters, for instance if the light map was loaded from the disk cache,
+	// the light map cannot be updated. Approximate horizon angles depend on the whole terrain
+	// through the far field, they cannot be updated in a region.
+	if (parameters.horizonNearFieldRadius > 0
+		|| !findHorizonAngles(parameters.horizonDirections, parameters.horizonPrecision, parameters.horizonNearFieldRadius))
+	{
+		m_horizonAngles.reset();
+		return false;
+	}
+
+	// A bake in progress may still read the horizon angles, in this case they are copied.
+	// Otherwise they are updated in place: they are never allocated as const, see loadOrComputeHorizonAngles.
+	std::shared_ptr<AnyHorizonAngles> horizonAngles;
+	if (m_horizonAngles.use_count() > 1)
+	{
+		horizonAngles = std::make_shared<AnyHorizonAngles>(*m_horizonAngles);
+	}
+	else
+	{
+		horizonAngles = std::const_pointer_cast<AnyHorizonAngles>(m_horizonAngles);
+	}
+	m_horizonAngles = horizonAngles;
+
+	const QRect changed = updateHorizonAngles(m_terrain, *horizonAngles, region);
+
+	if (lightMap.empty())
+	{
+		return false;
+	}
+
+	// The normals changed around the region too
+	lightMapRegion = updateLightMap(m_terrain, *horizonAngles, parameters,
+									changed.united(region.adjusted(-1, -1, 1, 1)), lightMap);
+
+	m_lightMaps[key] = std::move(lightMap);
+
+	return true;
+}
+
+TerrainProducts::LightMapKey TerrainViewer::TerrainProducts::lightMapKey(const Parameters& parameters)
+{
+	// The local light depends on the number of directions and on its radius, stored in place of the near field radius
+	if (parameters.shading == Shading::localLight)
+	{
+		return LightMapKey(parameters.shading, parameters.horizonDirections, HorizonPrecision::float32, parameters.localLightRadius);
+	}
+
+	// Other light maps do not depend on the horizon angles
+	if (!shadingUsesHorizonAngles(parameters.shading))
+	{
+		return LightMapKey(parameters.shading, HorizonDirections::sixteen, HorizonPrecision::float32, 0);
+	}
+
+	return LightMapKey(parameters.shading,
+					   parameters.horizonDirections,
+					   parameters.horizonPrecision,
+					   parameters.horizonNearFieldRadius);
+}
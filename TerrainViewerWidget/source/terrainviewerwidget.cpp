@@ -1,10 +1,12 @@
 #include "terrainviewerwidget.h"
 
 #include <vector>
+#include <cmath>
 #include <cassert>
 
 #include <QMouseEvent>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLPixelTransferOptions>
 
 #include "utils.h"
 #include "tessellation_utils.h"
@@ -17,6 +19,14 @@ using namespace TerrainViewer;
 const Parameters TerrainViewerWidget::default_parameters = {
 	Palette::demScreen,
 	Shading::uniformLight,
+	HorizonDirections::sixteen,
+	HorizonPrecision::float32,
+	0,
+	false,
+	45.0f,
+	30.0f,
+	LightChannel::ambientOcclusion,
+	32,
 	false,
 	1.f,
 	0.001f,
@@ -36,17 +46,32 @@ TerrainViewerWidget::TerrainViewerWidget(QWidget *parent) :
 	m_logger(new QOpenGLDebugLogger(this)),
 	m_program(nullptr),
 	m_computeNormalsProgram(nullptr),
+	m_computeHorizonProgram(nullptr),
+	m_remapLightMapProgram(nullptr),
 	m_terrain(0.0f, 0.0f, 0.0f),
+	m_products(m_terrain),
+	m_bakeRequest(0),
+	m_bakeCancelled(nullptr),
 	m_heightTexture(QOpenGLTexture::Target2D),
 	m_normalTexture(QOpenGLTexture::Target2D),
 	m_lightMapTexture(QOpenGLTexture::Target2D),
+	m_horizonTexture(QOpenGLTexture::Target2DArray),
+	m_overlayTexture(QOpenGLTexture::Target2D),
+	m_overlayEnabled(false),
+	m_horizonHullBuffer(0),
+	m_lightMapRangeBuffer(0),
 	m_camera({ 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, 45.0f, 1.0f, 0.01f, 100.0f)
 {
-	
+	// Bakes use all cores with OpenMP, a single worker is enough
+	m_bakeThreadPool.setMaxThreadCount(1);
 }
 
 TerrainViewerWidget::~TerrainViewerWidget()
 {
+	// The bake in progress uses the widget, wait for it before destroying the members
+	cancelLightMapBake();
+	m_bakeThreadPool.waitForDone();
+
 	cleanup();
 }
 
@@ -65,6 +90,11 @@ const Parameters& TerrainViewerWidget::parameters() const
 	return m_parameters;
 }
 
+TerrainProducts& TerrainViewerWidget::products()
+{
+	return m_products;
+}
+
 void TerrainViewerWidget::cleanup()
 {
 	if (m_program)
@@ -75,8 +105,16 @@ void TerrainViewerWidget::cleanup()
 		m_heightTexture.destroy();
 		m_normalTexture.destroy();
 		m_lightMapTexture.destroy();
+		m_horizonTexture.destroy();
+		m_overlayTexture.destroy();
+		glDeleteBuffers(1, &m_horizonHullBuffer);
+		glDeleteBuffers(1, &m_lightMapRangeBuffer);
+		m_horizonHullBuffer = 0;
+		m_lightMapRangeBuffer = 0;
 		m_program.reset(nullptr);
 		m_computeNormalsProgram.reset(nullptr);
+		m_computeHorizonProgram.reset(nullptr);
+		m_remapLightMapProgram.reset(nullptr);
 		m_waterSimulation.cleanup();
 		doneCurrent();
 	}
@@ -134,6 +172,24 @@ bool TerrainViewerWidget::reloadShaderPrograms()
 		success &= m_computeNormalsProgram->link();
 	}
 
+	if (m_computeHorizonProgram)
+	{
+		m_computeHorizonProgram->removeAllShaders();
+
+		m_computeHorizonProgram->addShaderFromSourceFile(QOpenGLShader::Compute, shader_dir + "compute_horizon_occlusion.glsl");
+
+		success &= m_computeHorizonProgram->link();
+	}
+
+	if (m_remapLightMapProgram)
+	{
+		m_remapLightMapProgram->removeAllShaders();
+
+		m_remapLightMapProgram->addShaderFromSourceFile(QOpenGLShader::Compute, shader_dir + "compute_light_map_remap.glsl");
+
+		success &= m_remapLightMapProgram->link();
+	}
+
 	if (m_program)
 	{
 		m_program->removeAllShaders();
@@ -150,10 +206,15 @@ bool TerrainViewerWidget::reloadShaderPrograms()
 }
 
 void TerrainViewerWidget::loadTerrain(const Terrain& terrain)
+{
+	loadTerrain(Terrain(terrain));
+}
+
+void TerrainViewerWidget::loadTerrain(Terrain&& terrain)
 {
 	assert(!terrain.empty());
 
-	m_terrain = terrain;
+	m_terrain = std::move(terrain);
 
 	// Generate patches to match the terrain. The minimum number of patch to generate is 1.
 	m_numberPatchesHeight = std::max(1, m_terrain.resolutionHeight() / 32);
@@ -167,18 +228,104 @@ void TerrainViewerWidget::loadTerrain(const Terrain& terrain)
 	m_vbo.allocate(patches.data(), patches.size() * sizeof(TessellationPatch));
 	m_vbo.release();
 
-	// Precompute the horizon angles
-	m_horizonAngles = computeHorizonAngles(m_terrain);
+	// Products of the previous terrain are obsolete, they are computed again when needed
+	m_products.clear();
+	m_bakeTerrain.reset();
 
 	// Init the water simulation for this terrain
 	m_waterSimulation.setInitialWaterLevel(0.0f);
-	m_waterSimulation.initSimulation(context(), terrain);
+	m_waterSimulation.initSimulation(context(), m_terrain);
 	m_waterSimulation.stop();
 	
 	// Init the textures storing the information of the terrain
 	initTerrainTexture();
 	initNormalTexture();
-	initLightMapTexture();
+
+	// The light map of the previous terrain is obsolete, the terrain is displayed without occlusion until its light map is baked
+	initLightMapTexture({ 1.0f }, 1, 1);
+
+	// The horizons of the previous terrain are obsolete, the horizon is flat and the sun is never occluded
+	// until the horizon angles of this terrain are computed
+	initFlatHorizonTexture();
+
+	// The overlay of the previous terrain is obsolete, a texture is always bound even if it is not displayed
+	initOverlayTexture({ 0 }, 1, 1);
+	m_overlayEnabled = false;
+
+	requestLightMap();
+
+	update();
+}
+
+void TerrainViewerWidget::updateTerrain(const Terrain& terrain, const QRect& region)
+{
+	assert(terrain.resolutionWidth() == m_terrain.resolutionWidth());
+	assert(terrain.resolutionHeight() == m_terrain.resolutionHeight());
+
+	const QRect cells = region.intersected(QRect(0, 0, m_terrain.resolutionWidth(), m_terrain.resolutionHeight()));
+	if (cells.isEmpty())
+	{
+		return;
+	}
+
+	// A bake in progress uses the previous altitudes, its result is discarded
+	cancelLightMapBake();
+	++m_bakeRequest;
+	m_bakeTerrain.reset();
+
+	// The widget keeps its own altitudes and only the region is copied. Sharing the edited terrain
+	// would copy all the altitudes again before the next edit, when the caller modifies them.
+	std::vector<float> altitudes(static_cast<size_t>(cells.width()) * cells.height());
+	for (int r = 0; r < cells.height(); r++)
+	{
+		float* row = altitudes.data() + static_cast<size_t>(r) * cells.width();
+		terrain.copyRow(cells.top() + r, cells.left(), cells.width(), row);
+		m_terrain.setRow(cells.top() + r, cells.left(), cells.width(), row);
+	}
+
+	makeCurrent();
+
+	// Normals are computed again on the GPU from the updated height map, textures are row major.
+	// Edited terrains are stored as floats, a 16 bits terrain is uploaded again as a whole.
+	if (m_heightTexture.format() == QOpenGLTexture::R32F)
+	{
+		m_heightTexture.setData(cells.left(), cells.top(), 0, cells.width(), cells.height(), 1,
+								QOpenGLTexture::Red, QOpenGLTexture::Float32, altitudes.data());
+	}
+	else
+	{
+		initTerrainTexture();
+	}
+	computeNormalsOnShader();
+
+	// The water flows over the new altitudes, the water map is kept
+	m_waterSimulation.updateTerrain(cells, altitudes.data());
+
+	QRect lightMapRegion;
+	if (m_products.update(cells, m_parameters, lightMapRegion))
+	{
+		// The light map of the parameters is already displayed, only the changed region is uploaded
+		if (!lightMapRegion.isEmpty())
+		{
+			uploadTextureRegion(m_lightMapTexture, m_products.findLightMap(m_parameters)->data(), lightMapRegion,
+								lightMapChannels(m_parameters.shading));
+
+			// The horizon angles that changed are in the region of the light map
+			if (m_parameters.shading == Shading::sunLight)
+			{
+				uploadHorizonTexture(*m_products.findHorizonAngles(m_parameters.horizonDirections,
+																   m_parameters.horizonPrecision,
+																   m_parameters.horizonNearFieldRadius),
+									 lightMapRegion);
+			}
+		}
+	}
+	else
+	{
+		requestLightMap();
+	}
+
+	doneCurrent();
 
 	update();
 }
@@ -191,16 +338,21 @@ void TerrainViewerWidget::setCamera(const OrbitCamera& camera)
 void TerrainViewerWidget::setParameters(const Parameters& parameters)
 {
 	const bool shadingChanged = (m_parameters.shading != parameters.shading);
+	const bool directionsChanged = (m_parameters.horizonDirections != parameters.horizonDirections)
+								|| (m_parameters.horizonPrecision != parameters.horizonPrecision)
+								|| (m_parameters.horizonNearFieldRadius != parameters.horizonNearFieldRadius)
+								|| (m_parameters.lightMapOnGpu != parameters.lightMapOnGpu)
+								|| (m_parameters.localLightRadius != parameters.localLightRadius);
 
 	m_parameters = parameters;
 
 	if (m_program)
 	{
-		// Update the light map if the lighting model changed
-		if (shadingChanged)
+		// Update the light map if the lighting model or the horizon angles changed
+		if ((shadingChanged || directionsChanged) && !m_terrain.empty())
 		{
 			makeCurrent();
-			initLightMapTexture();
+			requestLightMap();
 			doneCurrent();
 		}
 
@@ -217,6 +369,26 @@ void TerrainViewerWidget::setParameters(const Parameters& parameters)
 	}
 }
 
+void TerrainViewerWidget::setOverlay(const std::vector<uint8_t>& mask)
+{
+	assert(mask.size() == static_cast<size_t>(m_terrain.resolutionWidth()) * m_terrain.resolutionHeight());
+
+	makeCurrent();
+	initOverlayTexture(mask, m_terrain.resolutionWidth(), m_terrain.resolutionHeight());
+	doneCurrent();
+
+	m_overlayEnabled = true;
+
+	update();
+}
+
+void TerrainViewerWidget::clearOverlay()
+{
+	m_overlayEnabled = false;
+
+	update();
+}
+
 void TerrainViewerWidget::startWaterSimulation()
 {
 	makeCurrent();
@@ -252,10 +424,15 @@ void TerrainViewerWidget::initializeGL()
 	glClearColor(0.5, 0.5, 0.5, 1.0);
 
 	m_computeNormalsProgram = std::make_unique<QOpenGLShaderProgram>();
+	m_computeHorizonProgram = std::make_unique<QOpenGLShaderProgram>();
+	m_remapLightMapProgram = std::make_unique<QOpenGLShaderProgram>();
 	m_program = std::make_unique<QOpenGLShaderProgram>();
 
 	reloadShaderPrograms();
 
+	glGenBuffers(1, &m_horizonHullBuffer);
+	glGenBuffers(1, &m_lightMapRangeBuffer);
+
 	m_program->bind();
 
 	// Create a vertex array object.
@@ -337,8 +514,18 @@ void TerrainViewerWidget::paintGL()
 		// Update parameters
 		m_program->setUniformValue("palette", static_cast<int>(m_parameters.palette));
 		m_program->setUniformValue("shading", static_cast<int>(m_parameters.shading));
+		// Until the light map with several channels is baked, the previous one has only one channel
+		m_program->setUniformValue("light_channel", (m_lightMapTexture.format() == QOpenGLTexture::RGB32F) ? displayedLightMapChannel(m_parameters) : 0);
 		m_program->setUniformValue("pixelsPerTriangleEdge", m_parameters.pixelsPerTriangleEdge);
 
+		// Update the sun, the horizon angles are interpolated between its two closest directions
+		m_program->setUniformValue("sun_azimuth", static_cast<float>(m_parameters.sunAzimuth * M_PI / 180.0));
+		m_program->setUniformValue("sun_elevation", static_cast<float>(m_parameters.sunElevation * M_PI / 180.0));
+		m_program->setUniformValue("terrain.horizon_directions", m_horizonTexture.layers());
+		m_program->setUniformValue("terrain.horizon_scale", (m_horizonTexture.format() == QOpenGLTexture::R32F) ? 1.0f : float(M_PI_2));
+		m_program->setUniformValue("terrain.height_scale", heightTextureScale());
+		m_program->setUniformValue("overlay_enabled", m_overlayEnabled);
+
 		// Bind the height texture
 		const auto heightTextureUnit = 0;
 		m_program->setUniformValue("terrain.height_texture", heightTextureUnit);
@@ -359,6 +546,16 @@ void TerrainViewerWidget::paintGL()
 		m_program->setUniformValue("terrain.waterMap_texture", waterMapTextureUnit);
 		m_waterSimulation.waterMapTexture().bind(waterMapTextureUnit);
 
+		// Bind the horizon texture
+		const auto horizonTextureUnit = 4;
+		m_program->setUniformValue("terrain.horizon_texture", horizonTextureUnit);
+		m_horizonTexture.bind(horizonTextureUnit);
+
+		// Bind the overlay texture
+		const auto overlayTextureUnit = 5;
+		m_program->setUniformValue("terrain.overlay_texture", overlayTextureUnit);
+		m_overlayTexture.bind(overlayTextureUnit);
+
 		// Bind the VAO containing the patches
 		QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
 
@@ -377,6 +574,8 @@ void TerrainViewerWidget::paintGL()
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		}
 
+		m_overlayTexture.release();
+		m_horizonTexture.release();
 		m_waterSimulation.waterMapTexture().release();
 		m_lightMapTexture.release();
 		m_normalTexture.release();
@@ -457,10 +656,11 @@ void TerrainViewerWidget::computeNormalsOnShader()
 		// Update uniform values
 		m_computeNormalsProgram->setUniformValue("terrain_height", m_terrain.height());
 		m_computeNormalsProgram->setUniformValue("terrain_width", m_terrain.width());
+		m_computeNormalsProgram->setUniformValue("height_scale", heightTextureScale());
 
-		// Bind the height texture as an image
-		const auto heightImageUnit = 0;
-		glBindImageTexture(heightImageUnit, m_heightTexture.textureId(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		// Bind the height texture, sampled because images cannot read normalized 16 bits textures in GLSL 4.30
+		const auto heightTextureUnit = 0;
+		m_heightTexture.bind(heightTextureUnit);
 
 		const auto waterImageUnit = 1;
 		glBindImageTexture(waterImageUnit, m_waterSimulation.waterMapTexture().textureId(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
@@ -479,23 +679,204 @@ void TerrainViewerWidget::computeNormalsOnShader()
 		// Unbind the images
 		glBindImageTexture(normalImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 		glBindImageTexture(waterImageUnit, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-		glBindImageTexture(heightImageUnit, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		m_heightTexture.release(heightTextureUnit);
 
 		m_computeNormalsProgram->release();
 	}
 }
 
+void TerrainViewerWidget::bakeLightMapOnShader()
+{
+	// Local sizes in the compute shaders
+	const int localSizeSweeps = 64;
+	const int localSizeX = 4;
+	const int localSizeY = 4;
+
+	// Maximum number of points in the convex hulls of one dispatch, i.e. 64 MB
+	const int maxHullPoints = 8 * 1024 * 1024;
+
+	if (!m_computeHorizonProgram || !m_remapLightMapProgram)
+	{
+		return;
+	}
+
+	assert(shadingUsesHorizonAngles(m_parameters.shading));
+
+	const int width = m_terrain.resolutionWidth();
+	const int height = m_terrain.resolutionHeight();
+
+	// The light map is written by the shaders, only its storage is allocated
+	if (!m_lightMapTexture.isCreated()
+	 || m_lightMapTexture.width() != width
+	 || m_lightMapTexture.height() != height
+	 || m_lightMapTexture.format() != QOpenGLTexture::R32F)
+	{
+		initLightMapTexture(width, height);
+	}
+
+	// Same light directions and intensities as computeLightMap
+	const std::vector<HorizonDirection> directions = horizonDirections(m_parameters.horizonDirections);
+	const int nbDirections = static_cast<int>(directions.size());
+
+	int firstDirection = 0;
+	int lastDirection = nbDirections;
+	float lightIntensity = 1.0f;
+	if (m_parameters.shading == Shading::directionalLight)
+	{
+		firstDirection = nbDirections / 8;
+		lastDirection = firstDirection + 1;
+		lightIntensity = nbDirections / 2.0f;
+	}
+
+	// With the sun, the horizon angles are stored too, quantized by the GPU if needed, see initHorizonTexture
+	const bool storeHorizons = (m_parameters.shading == Shading::sunLight);
+	GLenum horizonImageFormat = GL_R32F;
+	float horizonScale = 1.0f;
+	if (storeHorizons)
+	{
+		initHorizonTexture(width, height, nbDirections, m_parameters.horizonPrecision);
+
+		if (m_parameters.horizonPrecision != HorizonPrecision::float32)
+		{
+			horizonImageFormat = (m_parameters.horizonPrecision == HorizonPrecision::uint16) ? GL_R16 : GL_R8;
+			horizonScale = float(M_PI_2);
+		}
+	}
+
+	// Each sweep line of a dispatch has its own convex hull, with at most one point per cell of the line
+	const int hullCapacity = std::max(width, height);
+	const int sweepsPerDispatch = std::max(1, maxHullPoints / hullCapacity / localSizeSweeps) * localSizeSweeps;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_horizonHullBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(sweepsPerDispatch) * hullCapacity * 2 * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_computeHorizonProgram->bind();
+
+	// Update uniform values
+	m_computeHorizonProgram->setUniformValue("terrain_height", m_terrain.height());
+	m_computeHorizonProgram->setUniformValue("terrain_width", m_terrain.width());
+	m_computeHorizonProgram->setUniformValue("hull_capacity", hullCapacity);
+	m_computeHorizonProgram->setUniformValue("shading", (m_parameters.shading == Shading::uniformLightBasic) ? 0 : 1);
+	m_computeHorizonProgram->setUniformValue("nb_directions", nbDirections);
+	m_computeHorizonProgram->setUniformValue("normal_weight", lightIntensity / nbDirections);
+	m_computeHorizonProgram->setUniformValue("projection_weight", lightIntensity * static_cast<float>(std::sin(M_PI / nbDirections) / M_PI));
+	m_computeHorizonProgram->setUniformValue("store_horizons", storeHorizons);
+	m_computeHorizonProgram->setUniformValue("horizon_scale", horizonScale);
+	m_computeHorizonProgram->setUniformValue("height_scale", heightTextureScale());
+
+	// Bind the height texture, the light map texture as an image, and the convex hulls
+	const auto heightTextureUnit = 0;
+	const auto lightMapImageUnit = 1;
+	const auto hullBufferBinding = 0;
+	m_heightTexture.bind(heightTextureUnit);
+	glBindImageTexture(lightMapImageUnit, m_lightMapTexture.textureId(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, hullBufferBinding, m_horizonHullBuffer);
+
+	// All the layers of the horizon texture, one per direction
+	const auto horizonImageUnit = 2;
+	if (storeHorizons)
+	{
+		glBindImageTexture(horizonImageUnit, m_horizonTexture.textureId(), 0, GL_TRUE, 0, GL_WRITE_ONLY, horizonImageFormat);
+	}
+
+	for (int d = firstDirection; d < lastDirection; d++)
+	{
+		const int di = directions[d].di;
+		const int dj = directions[d].dj;
+
+		glUniform2i(m_computeHorizonProgram->uniformLocation("direction"), dj, di);
+		m_computeHorizonProgram->setUniformValue("azimuth", QVector2D(directions[d].cosine, directions[d].sine));
+		// The first direction overwrites the previous light map
+		m_computeHorizonProgram->setUniformValue("accumulate", d > firstDirection);
+		m_computeHorizonProgram->setUniformValue("horizon_layer", d);
+
+		// Sweep lines cover every cell once per direction, see horizonSweepCount
+		const int sweepCount = std::abs(di) * width + std::abs(dj) * height - std::abs(di) * std::abs(dj);
+		m_computeHorizonProgram->setUniformValue("sweep_count", sweepCount);
+
+		for (int firstSweep = 0; firstSweep < sweepCount; firstSweep += sweepsPerDispatch)
+		{
+			m_computeHorizonProgram->setUniformValue("first_sweep", firstSweep);
+
+			// Launch the compute shader, the convex hulls are reused by the next dispatch
+			const int sweeps = std::min(sweepsPerDispatch, sweepCount - firstSweep);
+			glDispatchCompute(1 + (sweeps - 1) / localSizeSweeps, 1, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+	}
+
+	if (storeHorizons)
+	{
+		glBindImageTexture(horizonImageUnit, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY, horizonImageFormat);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, hullBufferBinding, 0);
+	m_heightTexture.release(heightTextureUnit);
+
+	m_computeHorizonProgram->release();
+
+	// The basic occlusion is remapped between 0 and 1, see remapOcclusion
+	if (m_parameters.shading == Shading::uniformLightBasic)
+	{
+		const GLuint initialRange[2] = { 0xFFFFFFFFu, 0u };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightMapRangeBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(initialRange), initialRange, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		const auto rangeBufferBinding = 1;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, rangeBufferBinding, m_lightMapRangeBuffer);
+
+		m_remapLightMapProgram->bind();
+
+		const int blocksX = std::max(1, 1 + ((width - 1) / localSizeX));
+		const int blocksY = std::max(1, 1 + ((height - 1) / localSizeY));
+
+		// First find the range of the light map, then remap it
+		m_remapLightMapProgram->setUniformValue("remap", false);
+		glDispatchCompute(blocksX, blocksY, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		m_remapLightMapProgram->setUniformValue("remap", true);
+		glDispatchCompute(blocksX, blocksY, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		m_remapLightMapProgram->release();
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, rangeBufferBinding, 0);
+	}
+
+	glBindImageTexture(lightMapImageUnit, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+	// The light map and the horizon angles are then sampled in the fragment shader
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
 void TerrainViewerWidget::initTerrainTexture()
 {
+	const bool normalized = (m_terrain.sampleType() == TerrainSampleType::uint16);
+
 	m_heightTexture.destroy();
 	m_heightTexture.create();
-	m_heightTexture.setFormat(QOpenGLTexture::R32F);
+	m_heightTexture.setFormat(normalized ? QOpenGLTexture::R16_UNorm : QOpenGLTexture::R32F);
 	m_heightTexture.setMinificationFilter(QOpenGLTexture::Linear);
 	m_heightTexture.setMagnificationFilter(QOpenGLTexture::Linear);
 	m_heightTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
 	m_heightTexture.setSize(m_terrain.resolutionWidth(), m_terrain.resolutionHeight());
 	m_heightTexture.allocateStorage();
-	m_heightTexture.setData(QOpenGLTexture::Red, QOpenGLTexture::Float32, m_terrain.data());
+
+	// Textures are row major, the altitudes of a tiled terrain are converted.
+	// Rows of 16 bits samples are not aligned on 4 bytes if the resolution is odd.
+	const Terrain rowMajor = m_terrain.withLayout(TerrainLayout::rowMajor);
+	QOpenGLPixelTransferOptions options;
+	options.setAlignment(normalized ? 2 : 4);
+	m_heightTexture.setData(QOpenGLTexture::Red, normalized ? QOpenGLTexture::UInt16 : QOpenGLTexture::Float32,
+							rowMajor.samples<void>(), &options);
+}
+
+float TerrainViewerWidget::heightTextureScale() const
+{
+	// Normalized 16 bits samples are read between 0 and 1
+	return (m_heightTexture.format() == QOpenGLTexture::R16_UNorm) ? m_terrain.maxAltitude() : 1.0f;
 }
 
 void TerrainViewerWidget::initNormalTexture()
@@ -513,17 +894,303 @@ void TerrainViewerWidget::initNormalTexture()
 	computeNormalsOnShader();	
 }
 
-void TerrainViewerWidget::initLightMapTexture()
+void TerrainViewerWidget::initLightMapTexture(int resolutionWidth, int resolutionHeight, int channels)
 {
-	const std::vector<float> lightMap = computeLightMap(m_terrain, m_horizonAngles, m_parameters);
+	assert(channels == 1 || channels == 3);
 
 	m_lightMapTexture.destroy();
 	m_lightMapTexture.create();
-	m_lightMapTexture.setFormat(QOpenGLTexture::R32F);
+	m_lightMapTexture.setFormat((channels == 3) ? QOpenGLTexture::RGB32F : QOpenGLTexture::R32F);
 	m_lightMapTexture.setMinificationFilter(QOpenGLTexture::Linear);
 	m_lightMapTexture.setMagnificationFilter(QOpenGLTexture::Linear);
 	m_lightMapTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
-	m_lightMapTexture.setSize(m_terrain.resolutionWidth(), m_terrain.resolutionHeight());
+	m_lightMapTexture.setSize(resolutionWidth, resolutionHeight);
 	m_lightMapTexture.allocateStorage();
-	m_lightMapTexture.setData(QOpenGLTexture::Red, QOpenGLTexture::Float32, lightMap.data());
+}
+
+void TerrainViewerWidget::initLightMapTexture(const std::vector<float>& lightMap, int resolutionWidth, int resolutionHeight, int channels)
+{
+	assert(lightMap.size() == static_cast<size_t>(resolutionWidth) * resolutionHeight * channels);
+
+	initLightMapTexture(resolutionWidth, resolutionHeight, channels);
+	m_lightMapTexture.setData((channels == 3) ? QOpenGLTexture::RGB : QOpenGLTexture::Red, QOpenGLTexture::Float32, lightMap.data());
+}
+
+void TerrainViewerWidget::initHorizonTexture(int resolutionWidth, int resolutionHeight, int nbDirections, HorizonPrecision precision)
+{
+	m_horizonTexture.destroy();
+	m_horizonTexture.create();
+
+	switch (precision)
+	{
+	case HorizonPrecision::float32:
+		m_horizonTexture.setFormat(QOpenGLTexture::R32F);
+		break;
+
+	case HorizonPrecision::uint16:
+		m_horizonTexture.setFormat(QOpenGLTexture::R16_UNorm);
+		break;
+
+	case HorizonPrecision::uint8:
+		m_horizonTexture.setFormat(QOpenGLTexture::R8_UNorm);
+		break;
+	}
+
+	// Directions are interpolated in the fragment shader, not between layers
+	m_horizonTexture.setMinificationFilter(QOpenGLTexture::Linear);
+	m_horizonTexture.setMagnificationFilter(QOpenGLTexture::Linear);
+	m_horizonTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
+	m_horizonTexture.setSize(resolutionWidth, resolutionHeight);
+	m_horizonTexture.setLayers(nbDirections);
+	m_horizonTexture.allocateStorage();
+}
+
+void TerrainViewerWidget::initOverlayTexture(const std::vector<uint8_t>& mask, int resolutionWidth, int resolutionHeight)
+{
+	m_overlayTexture.destroy();
+	m_overlayTexture.create();
+	m_overlayTexture.setFormat(QOpenGLTexture::R8_UNorm);
+	// The mask is not interpolated, cells are highlighted as a whole
+	m_overlayTexture.setMinificationFilter(QOpenGLTexture::Nearest);
+	m_overlayTexture.setMagnificationFilter(QOpenGLTexture::Nearest);
+	m_overlayTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
+	m_overlayTexture.setSize(resolutionWidth, resolutionHeight);
+	m_overlayTexture.allocateStorage();
+
+	// Rows of 8 bits values are not aligned
+	QOpenGLPixelTransferOptions options;
+	options.setAlignment(1);
+	m_overlayTexture.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8, mask.data(), &options);
+}
+
+void TerrainViewerWidget::initFlatHorizonTexture()
+{
+	const float flatHorizon = float(M_PI_2);
+	initHorizonTexture(1, 1, 1, HorizonPrecision::float32);
+	m_horizonTexture.setData(QOpenGLTexture::Red, QOpenGLTexture::Float32, &flatHorizon);
+}
+
+void TerrainViewerWidget::uploadHorizonTexture(const AnyHorizonAngles& horizonAngles, const QRect& region)
+{
+	std::visit([this, &region](const auto& angles) {
+		const int width = angles.resolutionWidth();
+		const int height = angles.resolutionHeight();
+		const int nbDirections = angles.nbDirections;
+
+		// Quantized angles are uploaded as they are, and normalized by the GPU
+		QOpenGLTexture::TextureFormat format = QOpenGLTexture::R32F;
+		QOpenGLTexture::PixelType pixelType = QOpenGLTexture::Float32;
+		size_t angleSize = sizeof(float);
+		if (angles.precision() == HorizonPrecision::uint16)
+		{
+			format = QOpenGLTexture::R16_UNorm;
+			pixelType = QOpenGLTexture::UInt16;
+			angleSize = sizeof(uint16_t);
+		}
+		else if (angles.precision() == HorizonPrecision::uint8)
+		{
+			format = QOpenGLTexture::R8_UNorm;
+			pixelType = QOpenGLTexture::UInt8;
+			angleSize = sizeof(uint8_t);
+		}
+
+		QRect cells = region.isEmpty() ? QRect(0, 0, width, height) : region;
+		if (!m_horizonTexture.isCreated()
+		 || m_horizonTexture.width() != width
+		 || m_horizonTexture.height() != height
+		 || m_horizonTexture.layers() != nbDirections
+		 || m_horizonTexture.format() != format)
+		{
+			initHorizonTexture(width, height, nbDirections, angles.precision());
+			cells = QRect(0, 0, width, height);
+		}
+
+		// Rows of the region are read from the whole plane, and rows of 8 bits angles are not aligned
+		QOpenGLPixelTransferOptions options;
+		options.setAlignment(1);
+		options.setRowLength(width);
+
+		const auto* data = static_cast<const unsigned char*>(angles.rawData());
+		for (int d = 0; d < nbDirections; d++)
+		{
+			const size_t offset = static_cast<size_t>(d) * angles.planeSize() + static_cast<size_t>(cells.top()) * width + cells.left();
+
+			m_horizonTexture.setData(cells.left(), cells.top(), 0,
+									 cells.width(), cells.height(), 1,
+									 0, d,
+									 QOpenGLTexture::Red, pixelType,
+									 data + offset * angleSize,
+									 &options);
+		}
+	}, horizonAngles);
+}
+
+void TerrainViewerWidget::uploadTextureRegion(QOpenGLTexture& texture, const float* data, const QRect& region, int channels)
+{
+	assert(texture.width() == m_terrain.resolutionWidth() && texture.height() == m_terrain.resolutionHeight());
+
+	// Rows of the region are read from the whole array
+	QOpenGLPixelTransferOptions options;
+	options.setRowLength(m_terrain.resolutionWidth());
+
+	texture.setData(region.left(), region.top(), 0,
+					region.width(), region.height(), 1,
+					(channels == 3) ? QOpenGLTexture::RGB : QOpenGLTexture::Red, QOpenGLTexture::Float32,
+					data + (static_cast<size_t>(region.top()) * m_terrain.resolutionWidth() + region.left()) * channels,
+					&options);
+}
+
+void TerrainViewerWidget::requestLightMap()
+{
+	// This request supersedes the previous one
+	cancelLightMapBake();
+	const int request = ++m_bakeRequest;
+
+	// Neither the light map nor the horizon angles are computed until a shading needs them,
+	// and the textures of the previous ones are released
+	if (!shadingUsesLightMap(m_parameters.shading))
+	{
+		initLightMapTexture({ 1.0f }, 1, 1);
+		initFlatHorizonTexture();
+		emit lightMapBakeProgress(1, 1);
+		return;
+	}
+
+	// The light map is baked in the texture, it is not shared with the products.
+	// Light maps with several channels are only baked on the CPU.
+	if (m_parameters.lightMapOnGpu
+	 && shadingUsesHorizonAngles(m_parameters.shading)
+	 && lightMapChannels(m_parameters.shading) == 1)
+	{
+		bakeLightMapOnShader();
+		emit lightMapBakeProgress(1, 1);
+		return;
+	}
+
+	// If the light map is already computed, it is displayed immediately
+	const std::vector<float>* lightMap = m_products.findLightMap(m_parameters);
+	const auto horizonAngles = m_products.findHorizonAngles(m_parameters.horizonDirections,
+															m_parameters.horizonPrecision,
+															m_parameters.horizonNearFieldRadius);
+
+	// With the sun, the horizon angles are displayed too, otherwise they are loaded or computed by the bake
+	if (lightMap != nullptr && (m_parameters.shading != Shading::sunLight || horizonAngles))
+	{
+		initLightMapTexture(*lightMap, m_terrain.resolutionWidth(), m_terrain.resolutionHeight(),
+							lightMapChannels(m_parameters.shading));
+
+		if (m_parameters.shading == Shading::sunLight)
+		{
+			uploadHorizonTexture(*horizonAngles);
+		}
+		emit lightMapBakeProgress(1, 1);
+		return;
+	}
+
+	if (!m_bakeTerrain)
+	{
+		m_bakeTerrain = std::make_shared<const Terrain>(m_terrain);
+	}
+
+	auto cancelled = std::make_shared<std::atomic<bool>>(false);
+	m_bakeCancelled = cancelled;
+
+	// Everything the bake reads is either copied or shared, so that the GUI thread can continue
+	const std::shared_ptr<const Terrain> terrain = m_bakeTerrain;
+	const Parameters parameters = m_parameters;
+	const HorizonCache cache = m_products.cache();
+
+	m_bakeThreadPool.start([this, request, terrain, parameters, horizonAngles, cache, cancelled]() {
+		// A newer request was made before this bake started
+		if (*cancelled)
+		{
+			return;
+		}
+
+		// The GPU upload is done in the GUI thread. If the widget is destroyed in the meantime,
+		// the destructor waits for this function, and the queued calls are discarded.
+		int passes = 1;
+		const auto showPreview = [this, request, parameters, cancelled, &passes](LightMapPreview preview) {
+			passes = preview.passes;
+			if (!*cancelled)
+			{
+				auto shared = std::make_shared<LightMapPreview>(std::move(preview));
+				QMetaObject::invokeMethod(this, [this, request, parameters, shared]() {
+					showLightMapPreview(request, parameters, std::move(*shared));
+				}, Qt::QueuedConnection);
+			}
+		};
+
+		auto bake = std::make_shared<LightMapBake>(bakeLightMap(*terrain, parameters, horizonAngles, cache, *cancelled, showPreview));
+
+		if (!*cancelled)
+		{
+			QMetaObject::invokeMethod(this, [this, request, parameters, passes, bake]() {
+				finishLightMapBake(request, parameters, passes, std::move(*bake));
+			}, Qt::QueuedConnection);
+		}
+	});
+}
+
+void TerrainViewerWidget::showLightMapPreview(int request, const Parameters& parameters, LightMapPreview preview)
+{
+	// Another light map was requested, or another terrain loaded, since this bake started
+	if (request != m_bakeRequest || preview.bake.lightMap.empty())
+	{
+		return;
+	}
+
+	// Texture coordinates are normalized, the preview covers the terrain at a lower resolution
+	makeCurrent();
+	initLightMapTexture(preview.bake.lightMap, preview.resolutionWidth, preview.resolutionHeight,
+						lightMapChannels(parameters.shading));
+	if (parameters.shading == Shading::sunLight && preview.bake.horizonAngles)
+	{
+		uploadHorizonTexture(*preview.bake.horizonAngles);
+	}
+	doneCurrent();
+
+	emit lightMapBakeProgress(preview.pass + 1, preview.passes);
+
+	update();
+}
+
+void TerrainViewerWidget::finishLightMapBake(int request, const Parameters& parameters, int passes, LightMapBake bake)
+{
+	// Another light map was requested, or another terrain loaded, since this bake started
+	if (request != m_bakeRequest || bake.lightMap.empty())
+	{
+		return;
+	}
+
+	// The bake is complete, there is nothing left to cancel
+	m_bakeCancelled.reset();
+
+	const std::shared_ptr<const AnyHorizonAngles> horizonAngles = bake.horizonAngles;
+	const std::vector<float>& lightMap = m_products.insert(parameters, std::move(bake));
+
+	// Swap the light map texture, and the horizon texture with the sun
+	makeCurrent();
+	initLightMapTexture(lightMap, m_terrain.resolutionWidth(), m_terrain.resolutionHeight(),
+						lightMapChannels(parameters.shading));
+	if (parameters.shading == Shading::sunLight && horizonAngles)
+	{
+		uploadHorizonTexture(*horizonAngles);
+	}
+	doneCurrent();
+
+	emit lightMapBakeProgress(passes, passes);
+
+	update();
+}
+
+void TerrainViewerWidget::cancelLightMapBake()
+{
+	if (m_bakeCancelled)
+	{
+		*m_bakeCancelled = true;
+		m_bakeCancelled.reset();
+
+		emit lightMapBakeCancelled();
+	}
 }
@@ -0,0 +1,216 @@
+#include "viewshed.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+#include <omp.h>
+
+using namespace TerrainViewer;
+
+/**
+ * \brief A ray from a cell of the terrain to another one, walked one step at a time on its major axis
+ */
+struct ViewshedRay
+{
+	// I coordinate of the first cell of the ray
+	int i;
+	// J coordinate of the first cell of the ray
+	int j;
+	// Offset on the I axis between the first and the last cells of the ray
+	int di;
+	// Offset on the J axis between the first and the last cells of the ray
+	int dj;
+	// Number of steps between the first and the last cells of the ray
+	int length;
+};
+
+/**
+ * \brief Return a ray between two cells of the terrain
+ * \param i1 I coordinate of the first cell
+ * \param j1 J coordinate of the first cell
+ * \param i2 I coordinate of the last cell
+ * \param j2 J coordinate of the last cell
+ * \return The ray between the two cells
+ */
+ViewshedRay viewshedRay(int i1, int j1, int i2, int j2)
+{
+	const int di = i2 - i1;
+	const int dj = j2 - j1;
+
+	return { i1, j1, di, dj, std::max(std::abs(di), std::abs(dj)) };
+}
+
+/**
+ * \brief Sample the terrain at a step of a ray. The point is on a row or a column of cells,
+ *        its altitude is interpolated between the two cells around it on the minor axis of the ray.
+ * \param terrain The terrain
+ * \param ray The ray
+ * \param step Index of the step, between 1 and the length of the ray
+ * \param distance Horizontal distance between the point and the first cell of the ray
+ * \param ci I coordinate of the cell closest to the point
+ * \param cj J coordinate of the cell closest to the point
+ * \return The altitude of the terrain at the point
+ */
+float viewshedRaySample(const Terrain& terrain, const ViewshedRay& ray, int step, float& distance, int& ci, int& cj)
+{
+	assert(step > 0 && step <= ray.length);
+
+	const bool majorI = std::abs(ray.di) >= std::abs(ray.dj);
+	const int majorOffset = majorI ? ray.di : ray.dj;
+	const int minorOffset = majorI ? ray.dj : ray.di;
+
+	// Offset on the major axis is exact, offset on the minor axis is lower + remainder / length
+	const int major = (majorOffset < 0) ? -step : step;
+	int lower = (minorOffset * step) / ray.length;
+	int remainder = (minorOffset * step) % ray.length;
+	if (remainder < 0)
+	{
+		lower--;
+		remainder += ray.length;
+	}
+	const float t = float(remainder) / ray.length;
+	const int nearest = lower + ((2 * remainder >= ray.length) ? 1 : 0);
+
+	const int oi = majorI ? major : lower;
+	const int oj = majorI ? lower : major;
+	ci = ray.i + (majorI ? major : nearest);
+	cj = ray.j + (majorI ? nearest : major);
+
+	const float fi = majorI ? float(major) : float(lower) + t;
+	const float fj = majorI ? float(lower) + t : float(major);
+	distance = std::sqrt(fi * fi * terrain.cellHeight() * terrain.cellHeight()
+					   + fj * fj * terrain.cellWidth() * terrain.cellWidth());
+
+	const float h0 = terrain(ray.i + oi, ray.j + oj);
+	if (remainder == 0)
+	{
+		return h0;
+	}
+
+	const float h1 = majorI ? terrain(ray.i + oi, ray.j + oj + 1) : terrain(ray.i + oi + 1, ray.j + oj);
+
+	return (1.0f - t) * h0 + t * h1;
+}
+
+/**
+ * \brief Return the slope between the observer and a cell, the horizontal distance is computed
+ *        from the cell itself and not from the sample of the ray closest to it
+ * \param terrain The terrain
+ * \param ray The ray from the observer
+ * \param i I coordinate of the cell
+ * \param j J coordinate of the cell
+ * \param altitude Altitude of the cell, with the height of the target
+ * \param eye Altitude of the observer, with its height
+ * \return The tangent of the angle between the horizontal and the line from the observer to the cell
+ */
+float viewshedCellSlope(const Terrain& terrain, const ViewshedRay& ray, int i, int j, float altitude, float eye)
+{
+	const float di = float(i - ray.i) * terrain.cellHeight();
+	const float dj = float(j - ray.j) * terrain.cellWidth();
+
+	return (altitude - eye) / std::sqrt(di * di + dj * dj);
+}
+
+std::vector<uint8_t> TerrainViewer::viewshed(const Terrain& terrain, int i, int j, float observerHeight, float targetHeight)
+{
+	const int height = terrain.resolutionHeight();
+	const int width = terrain.resolutionWidth();
+
+	assert(i >= 0 && i < height);
+	assert(j >= 0 && j < width);
+
+	std::vector<uint8_t> mask(static_cast<size_t>(width) * height, 0);
+	mask[terrain.cellIndex(i, j)] = 255;
+
+	// One ray to each cell on the border of the terrain, consecutive rays are at most one cell apart
+	// on any row or column they cross, hence every cell of the terrain is reached by at least one ray
+	std::vector<std::pair<int, int>> borders;
+	borders.reserve(2 * static_cast<size_t>(width + height));
+	for (int l = 0; l < width; l++)
+	{
+		borders.emplace_back(0, l);
+		borders.emplace_back(height - 1, l);
+	}
+	for (int k = 1; k < height - 1; k++)
+	{
+		borders.emplace_back(k, 0);
+		borders.emplace_back(k, width - 1);
+	}
+
+	const float eye = terrain(i, j) + observerHeight;
+
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int b = 0; b < static_cast<int>(borders.size()); b++)
+	{
+		const ViewshedRay ray = viewshedRay(i, j, borders[b].first, borders[b].second);
+
+		// Walk the ray away from the observer, a cell is visible if it is above all points before it
+		float maxSlope = -std::numeric_limits<float>::infinity();
+		for (int step = 1; step <= ray.length; step++)
+		{
+			float distance;
+			int ci, cj;
+			const float altitude = viewshedRaySample(terrain, ray, step, distance, ci, cj);
+
+			const float cellSlope = viewshedCellSlope(terrain, ray, ci, cj, terrain(ci, cj) + targetHeight, eye);
+			if (cellSlope >= maxSlope)
+			{
+				// Rays are concurrent near the observer, they can only mark the cell as visible
+#pragma omp atomic write
+				mask[terrain.cellIndex(ci, cj)] = 255;
+			}
+
+			maxSlope = std::max(maxSlope, (altitude - eye) / distance);
+		}
+	}
+
+	return mask;
+}
+
+bool TerrainViewer::lineOfSight(const Terrain& terrain, const LineOfSightQuery& query, float observerHeight, float targetHeight)
+{
+	const ViewshedRay ray = viewshedRay(query.i1, query.j1, query.i2, query.j2);
+
+	if (ray.length == 0)
+	{
+		return true;
+	}
+
+	const float eye = terrain(query.i1, query.j1) + observerHeight;
+	const float targetSlope = viewshedCellSlope(terrain, ray, query.i2, query.j2,
+												terrain(query.i2, query.j2) + targetHeight, eye);
+
+	// The target is hidden if a point between it and the observer is above the line of sight
+	for (int step = 1; step < ray.length; step++)
+	{
+		float distance;
+		int ci, cj;
+		const float altitude = viewshedRaySample(terrain, ray, step, distance, ci, cj);
+
+		if ((altitude - eye) / distance > targetSlope)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector<uint8_t> TerrainViewer::lineOfSight(const Terrain& terrain,
+												const std::vector<LineOfSightQuery>& queries,
+												float observerHeight,
+												float targetHeight)
+{
+	std::vector<uint8_t> visible(queries.size(), 0);
+
+	// Queries have very different lengths, they are distributed dynamically
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int q = 0; q < static_cast<int>(queries.size()); q++)
+	{
+		visible[q] = lineOfSight(terrain, queries[q], observerHeight, targetHeight) ? 1 : 0;
+	}
+
+	return visible;
+}
@@ -2,6 +2,7 @@
 
 #include <QOpenGLVersionFunctionsFactory>
 #include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLPixelTransferOptions>
 
 using namespace TerrainViewer;
 
@@ -47,6 +48,26 @@ void WaterSimulation::initSimulation(QOpenGLContext* context, const Terrain& ter
 	initTextures();
 }
 
+void WaterSimulation::updateTerrain(const QRect& region, const float* altitudes)
+{
+	// The simulation keeps its own altitudes, they are copied once and then only the region is written
+	for (int r = 0; r < region.height(); r++)
+	{
+		m_terrain.setRow(region.top() + r, region.left(), region.width(), altitudes + static_cast<size_t>(r) * region.width());
+	}
+
+	// Altitudes of a 16 bits terrain are converted to floats when they are modified, the texture is uploaded again as a whole
+	if (m_heightTexture.format() == QOpenGLTexture::R32F)
+	{
+		m_heightTexture.setData(region.left(), region.top(), 0, region.width(), region.height(), 1,
+								QOpenGLTexture::Red, QOpenGLTexture::Float32, altitudes);
+	}
+	else
+	{
+		initHeightTexture();
+	}
+}
+
 void WaterSimulation::computeIteration(QOpenGLContext* context)
 {
 	if (m_running)
@@ -71,6 +92,9 @@ void WaterSimulation::computeSingleIteration(QOpenGLContext* context)
 	const int localSizeX = 4;
 	const int localSizeY = 4;
 
+	// Normalized 16 bits altitudes are read between 0 and 1
+	const float heightScale = (m_heightTexture.format() == QOpenGLTexture::R16_UNorm) ? m_terrain.maxAltitude() : 1.0f;
+
 	if (m_computeFlowProgram)
 	{
 		m_computeFlowProgram->bind();
@@ -78,14 +102,15 @@ void WaterSimulation::computeSingleIteration(QOpenGLContext* context)
 		// Update uniform values
 		m_computeFlowProgram->setUniformValue("terrain_height", m_terrain.height());
 		m_computeFlowProgram->setUniformValue("terrain_width", m_terrain.width());
+		m_computeFlowProgram->setUniformValue("height_scale", heightScale);
 		m_computeFlowProgram->setUniformValue("time_step", m_timeStep);
 		m_computeFlowProgram->setUniformValue("water_increment", m_rainRate);
 		m_computeFlowProgram->setUniformValue("evaporation_rate", m_evaporationRate);
 		m_computeFlowProgram->setUniformValue("bounce_boundaries", m_bounceBoundaries);
 
-		// Bind the height texture as an image
-		const auto heightImageUnit = 0;
-		f->glBindImageTexture(heightImageUnit, m_heightTexture.textureId(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		// Bind the height texture, it is sampled to also read normalized 16 bits altitudes
+		const auto heightTextureUnit = 0;
+		m_heightTexture.bind(heightTextureUnit);
 
 		const auto waterImageUnit = 1;
 		f->glBindImageTexture(waterImageUnit, m_waterMapTexture.textureId(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
@@ -104,7 +129,7 @@ void WaterSimulation::computeSingleIteration(QOpenGLContext* context)
 		// Unbind the images
 		f->glBindImageTexture(outFlowImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 		f->glBindImageTexture(waterImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
-		f->glBindImageTexture(heightImageUnit, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		m_heightTexture.release(heightTextureUnit);
 
 		m_computeFlowProgram->release();
 	}
@@ -116,14 +141,15 @@ void WaterSimulation::computeSingleIteration(QOpenGLContext* context)
 		// Update uniform values
 		m_computeWaterMapProgram->setUniformValue("terrain_height", m_terrain.height());
 		m_computeWaterMapProgram->setUniformValue("terrain_width", m_terrain.width());
+		m_computeWaterMapProgram->setUniformValue("height_scale", heightScale);
 		m_computeWaterMapProgram->setUniformValue("time_step", m_timeStep);
 		m_computeWaterMapProgram->setUniformValue("water_increment", m_rainRate);
 		m_computeWaterMapProgram->setUniformValue("evaporation_rate", m_evaporationRate);
 		m_computeWaterMapProgram->setUniformValue("bounce_boundaries", m_bounceBoundaries);
 
-		// Bind the height texture as an image
-		const auto heightImageUnit = 0;
-		f->glBindImageTexture(heightImageUnit, m_heightTexture.textureId(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		// Bind the height texture, it is sampled to also read normalized 16 bits altitudes
+		const auto heightTextureUnit = 0;
+		m_heightTexture.bind(heightTextureUnit);
 
 		const auto waterImageUnit = 1;
 		f->glBindImageTexture(waterImageUnit, m_waterMapTexture.textureId(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
@@ -142,7 +168,7 @@ void WaterSimulation::computeSingleIteration(QOpenGLContext* context)
 		// Unbind the images
 		f->glBindImageTexture(outFlowImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 		f->glBindImageTexture(waterImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
-		f->glBindImageTexture(heightImageUnit, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		m_heightTexture.release(heightTextureUnit);
 
 		m_computeWaterMapProgram->release();
 	}
@@ -201,18 +227,28 @@ void WaterSimulation::initComputeShader()
 	m_computeWaterMapProgram->link();
 }
 
-void WaterSimulation::initTextures()
+void WaterSimulation::initHeightTexture()
 {
 	// TODO: reuse the texture from the terrain widget
 	m_heightTexture.destroy();
 	m_heightTexture.create();
-	m_heightTexture.setFormat(QOpenGLTexture::R32F);
+	const bool normalized = (m_terrain.sampleType() == TerrainSampleType::uint16);
+	m_heightTexture.setFormat(normalized ? QOpenGLTexture::R16_UNorm : QOpenGLTexture::R32F);
 	m_heightTexture.setMinificationFilter(QOpenGLTexture::Linear);
 	m_heightTexture.setMagnificationFilter(QOpenGLTexture::Linear);
 	m_heightTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
 	m_heightTexture.setSize(m_terrain.resolutionWidth(), m_terrain.resolutionHeight());
 	m_heightTexture.allocateStorage();
-	m_heightTexture.setData(QOpenGLTexture::Red, QOpenGLTexture::Float32, m_terrain.data());
+	const Terrain rowMajor = m_terrain.withLayout(TerrainLayout::rowMajor);
+	QOpenGLPixelTransferOptions options;
+	options.setAlignment(normalized ? 2 : 4);
+	m_heightTexture.setData(QOpenGLTexture::Red, normalized ? QOpenGLTexture::UInt16 : QOpenGLTexture::Float32,
+							rowMajor.samples<void>(), &options);
+}
+
+void WaterSimulation::initTextures()
+{
+	initHeightTexture();
 
 	const std::vector<float> initialWaterMap(m_terrain.resolutionWidth() * m_terrain.resolutionHeight(), m_initialWaterLevel);
 	m_waterMapTexture.destroy();